@@ -0,0 +1,931 @@
+#include "kirkpatrick_refinement.h"
+#include "dag_statistics.h"
+#include "dynamic_refinement.h"
+#include "polygon_generators.h"
+#include "query_executor.h"
+#include "refinement_collection.h"
+#include "snapshot_publisher.h"
+#include "static_dag.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <new>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <dirent.h>
+#include <sys/resource.h>
+
+using geom::algorithms::localization::kirkpatrick_refinement;
+using geom::algorithms::localization::construction_options;
+using geom::algorithms::localization::dag_statistics;
+using geom::algorithms::localization::dynamic_refinement;
+using geom::algorithms::localization::dynamic_options;
+using geom::algorithms::localization::query_stats;
+using geom::algorithms::localization::raster_type;
+using geom::algorithms::localization::refinement_collection;
+using geom::algorithms::localization::query_executor;
+using geom::algorithms::localization::executor_options;
+using geom::algorithms::localization::static_dag;
+using geom::algorithms::snapshot_publisher;
+using bench::point_type;
+
+namespace
+{
+  // heap allocations so far, counted by operator new
+  std::atomic<size_t> allocations(0);
+}
+
+// Both are kept out of line: inlined, gcc pairs the malloc of one with
+// the free of the other and warns of a mismatch.
+__attribute__((noinline)) void * operator new(size_t size)
+{
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void * p = std::malloc(size ? size : 1))
+    return p;
+  throw std::bad_alloc();
+}
+
+__attribute__((noinline)) void operator delete(void * p) noexcept
+{
+  std::free(p);
+}
+
+namespace
+{
+  typedef std::chrono::steady_clock clock_type;
+
+  struct options_type
+  {
+    size_t min_size = 100;
+    size_t max_size = 10000000;
+    size_t queries = 1000000;
+    // queries timed one by one for the latency percentiles
+    size_t latency_samples = 100000;
+    uint32_t seed = 1;
+    construction_options construction;
+    // build with the best threshold and selection for the queries
+    bool tune = false;
+    // dag and query statistics after every row
+    bool stats = false;
+    // streams of close queries: a track and the queries in Hilbert order
+    bool coherent = false;
+    // inside tests over three times the bounding box, mostly outside
+    bool classify = false;
+    // bytes of the query grid, none when 0
+    size_t grid = 0;
+    // side of a raster over the bounding box labelled by rows
+    size_t raster = 0;
+    // random edge splits applied to a dynamic_refinement of every polygon
+    size_t updates = 0;
+    // threads querying while the polygon is rebuilt and republished
+    size_t readers = 0;
+    // small polygons in one refinement_collection
+    size_t fences = 0;
+    // batch through a query_executor of threads workers
+    bool executor = false;
+    // static dags of small polygons next to their refinements
+    bool static_dags = false;
+    // regression baseline of the inputs to write or to compare against
+    std::string record;
+    std::string check;
+    std::vector<bench::shape_type> shapes;
+    std::string input = "input";
+    std::vector<std::string> files;
+  };
+
+  char const * const selection_names[] =
+    {"fifo", "lowest_degree", "randomized", "max_independent"};
+
+  double milliseconds(clock_type::time_point from, clock_type::time_point to)
+  {
+    return std::chrono::duration<double, std::milli>(to - from).count();
+  }
+
+  size_t peak_rss()
+  {
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    // kilobytes on linux
+    return size_t(usage.ru_maxrss) * 1024;
+  }
+
+  void print_header()
+  {
+    std::printf("%-24s %9s %9s %5s %10s %8s %9s %9s %9s %9s %7s %7s %7s %7s %7s\n",
+                "polygon", "vertices", "triangles", "depth", "build ms", "allocs",
+                "rss MB", "dag MB", "loop Mq/s", "batch Mq/s",
+                "p50 ns", "p90 ns", "p99 ns", "p999 ns", "max ns");
+  }
+
+  // splits random edges near their midpoints, then queries the result
+  void run_updates(std::vector<point_type> const & poly,
+                   std::vector<point_type> const & queries,
+                   options_type const & options)
+  {
+    std::vector<dynamic_refinement::id_type> ring(poly.size());
+    std::iota(ring.begin(), ring.end(), 0);
+    dynamic_options dynamic_options;
+    dynamic_options.construction = options.construction;
+    dynamic_refinement dynamic(poly, std::vector<std::vector<dynamic_refinement::id_type>>(1, ring),
+                               dynamic_options);
+
+    std::mt19937 random(options.seed);
+    size_t rejected = 0;
+    auto start = clock_type::now();
+    for (size_t k = 0; k < options.updates; ++k)
+      {
+        auto const & face = dynamic.faces()[0];
+        size_t i = std::uniform_int_distribution<size_t>(0, face.size() - 1)(random);
+        auto const & a = dynamic.points()[face[i]];
+        auto const & b = dynamic.points()[face[(i + 1) % face.size()]];
+        try
+          {
+            dynamic.insert_vertex(0, i, point_type(int32_t((a.x + b.x) / 2),
+                                                   int32_t((a.y + b.y) / 2)));
+          }
+        catch (std::invalid_argument const &)
+          {
+            ++rejected;
+          }
+      }
+    double update = milliseconds(start, clock_type::now());
+
+    std::vector<dynamic_refinement::id_type> result(queries.size());
+    start = clock_type::now();
+    dynamic.find_faces(queries.data(), queries.size(), result.data());
+    double batch = milliseconds(start, clock_type::now());
+    std::printf("  %zu updates: %.1f us per update, %zu rejected, %zu rebuilds, "
+                "overlay %zu triangles %zu deep, batch %.2f Mq/s\n",
+                options.updates, 1000 * update / options.updates, rejected,
+                dynamic.rebuilds_num(), dynamic.overlay_triangles_num(),
+                dynamic.overlay_depth(), queries.size() / batch / 1000);
+  }
+
+  // A random walk with steps of a thousandth of the bounding box, located
+  // as a stream and as a batch, and the random queries located in
+  // Hilbert order and as a batch.
+  void run_coherent(kirkpatrick_refinement const & refinement,
+                    std::vector<point_type> const & poly,
+                    std::vector<point_type> const & queries,
+                    options_type const & options)
+  {
+    int32_t min_x = poly[0].x, max_x = min_x, min_y = poly[0].y, max_y = min_y;
+    for (point_type const & p: poly)
+      {
+        min_x = std::min(min_x, p.x);
+        max_x = std::max(max_x, p.x);
+        min_y = std::min(min_y, p.y);
+        max_y = std::max(max_y, p.y);
+      }
+    std::mt19937 random(options.seed);
+    std::uniform_int_distribution<int64_t> dx(-(int64_t(max_x) - min_x) / 1000,
+                                              (int64_t(max_x) - min_x) / 1000);
+    std::uniform_int_distribution<int64_t> dy(-(int64_t(max_y) - min_y) / 1000,
+                                              (int64_t(max_y) - min_y) / 1000);
+    std::vector<point_type> track(queries.size());
+    int64_t x = (int64_t(min_x) + max_x) / 2, y = (int64_t(min_y) + max_y) / 2;
+    for (point_type & p: track)
+      {
+        x = std::min<int64_t>(max_x, std::max<int64_t>(min_x, x + dx(random)));
+        y = std::min<int64_t>(max_y, std::max<int64_t>(min_y, y + dy(random)));
+        p = point_type(int32_t(x), int32_t(y));
+      }
+
+    std::vector<kirkpatrick_refinement::id_type> result(queries.size());
+    auto time = [&](std::vector<point_type> const & points,
+                    void (kirkpatrick_refinement::*locate)(point_type const *, size_t,
+                                                           kirkpatrick_refinement::id_type *) const)
+      {
+        auto start = clock_type::now();
+        (refinement.*locate)(points.data(), points.size(), result.data());
+        return points.size() / milliseconds(start, clock_type::now()) / 1000;
+      };
+    double track_stream = time(track, &kirkpatrick_refinement::find_queries_coherent);
+    double track_batch = time(track, &kirkpatrick_refinement::find_queries);
+    double sorted = time(queries, &kirkpatrick_refinement::find_queries_sorted);
+    double batch = time(queries, &kirkpatrick_refinement::find_queries);
+    std::printf("  coherent: track %.2f Mq/s (batch %.2f), sorted %.2f Mq/s (batch %.2f)\n",
+                track_stream, track_batch, sorted, batch);
+  }
+
+  // inside tests against face queries, for queries from a box three
+  // times the size of the bounding box
+  void run_classify(kirkpatrick_refinement const & refinement,
+                    std::vector<point_type> const & poly,
+                    options_type const & options)
+  {
+    int32_t min_x = poly[0].x, max_x = min_x, min_y = poly[0].y, max_y = min_y;
+    for (point_type const & p: poly)
+      {
+        min_x = std::min(min_x, p.x);
+        max_x = std::max(max_x, p.x);
+        min_y = std::min(min_y, p.y);
+        max_y = std::max(max_y, p.y);
+      }
+    int64_t width = int64_t(max_x) - min_x, height = int64_t(max_y) - min_y;
+    std::mt19937 random(options.seed);
+    std::uniform_int_distribution<int64_t> x(min_x - width, max_x + width);
+    std::uniform_int_distribution<int64_t> y(min_y - height, max_y + height);
+    std::vector<point_type> queries(options.queries);
+    for (point_type & q: queries)
+      q = point_type(int32_t(x(random)), int32_t(y(random)));
+
+    std::unique_ptr<bool[]> inside(new bool[queries.size()]);
+    auto start = clock_type::now();
+    refinement.classify(queries.data(), queries.size(), inside.get());
+    double classify = milliseconds(start, clock_type::now());
+    std::vector<kirkpatrick_refinement::id_type> faces(queries.size());
+    start = clock_type::now();
+    refinement.find_faces(queries.data(), queries.size(), faces.data());
+    double find_faces = milliseconds(start, clock_type::now());
+    size_t inside_num = std::count(inside.get(), inside.get() + queries.size(), true);
+    std::printf("  classify: %.2f Mq/s (find_faces %.2f), %.1f%% inside\n",
+                queries.size() / classify / 1000, queries.size() / find_faces / 1000,
+                100.0 * inside_num / queries.size());
+  }
+
+  // labels a raster over the bounding box by rows and cell by cell
+  void run_raster(kirkpatrick_refinement const & refinement,
+                  std::vector<point_type> const & poly,
+                  options_type const & options)
+  {
+    int32_t min_x = poly[0].x, max_x = min_x, min_y = poly[0].y, max_y = min_y;
+    for (point_type const & p: poly)
+      {
+        min_x = std::min(min_x, p.x);
+        max_x = std::max(max_x, p.x);
+        min_y = std::min(min_y, p.y);
+        max_y = std::max(max_y, p.y);
+      }
+    raster_type raster;
+    raster.origin = point_type(min_x, min_y);
+    raster.width = raster.height = options.raster;
+    raster.step_x = int32_t(std::max<int64_t>(1, (int64_t(max_x) - min_x) / options.raster));
+    raster.step_y = int32_t(std::max<int64_t>(1, (int64_t(max_y) - min_y) / options.raster));
+    const size_t cells = raster.width * raster.height;
+
+    std::vector<kirkpatrick_refinement::id_type> labels(cells);
+    auto start = clock_type::now();
+    refinement.find_raster(raster, labels.data(), options.construction.threads);
+    double rows = milliseconds(start, clock_type::now());
+
+    std::vector<point_type> points(cells);
+    for (size_t j = 0; j < raster.height; ++j)
+      for (size_t i = 0; i < raster.width; ++i)
+        points[j * raster.width + i] = point_type(raster.origin.x + int32_t(i) * raster.step_x,
+                                                  raster.origin.y + int32_t(j) * raster.step_y);
+    start = clock_type::now();
+    refinement.find_queries(points.data(), cells, labels.data());
+    double batch = milliseconds(start, clock_type::now());
+    std::printf("  raster %zux%zu: %.2f Mcells/s (batch %.2f)\n",
+                raster.width, raster.height, cells / rows / 1000, cells / batch / 1000);
+  }
+
+  // readers query without pause while the main thread republishes
+  void run_reloads(std::vector<point_type> const & poly,
+                   std::vector<point_type> const & queries,
+                   options_type const & options)
+  {
+    const size_t RELOADS = 3;
+    snapshot_publisher<kirkpatrick_refinement> publisher(
+      std::unique_ptr<kirkpatrick_refinement>(
+        new kirkpatrick_refinement(poly, options.construction)),
+      options.readers);
+
+    std::atomic<bool> stop(false);
+    // printed, so the queries are not optimized away
+    std::atomic<size_t> checksum(0);
+    std::vector<size_t> counts(options.readers);
+    std::vector<double> worst(options.readers);
+    std::vector<std::thread> threads;
+    for (size_t r = 0; r < options.readers; ++r)
+      threads.emplace_back([&, r]()
+                           {
+                             auto reader = publisher.make_reader();
+                             size_t count = 0, sum = 0;
+                             double slowest = 0;
+                             for (size_t i = r; !stop.load(std::memory_order_relaxed);
+                                  i = (i + 1) % queries.size(), ++count)
+                               {
+                                 auto before = clock_type::now();
+                                 auto snapshot = reader.pin();
+                                 sum += snapshot->find_query(queries[i]);
+                                 slowest = std::max(slowest, std::chrono::duration<double, std::nano>(
+                                                      clock_type::now() - before).count());
+                               }
+                             checksum += sum;
+                             counts[r] = count;
+                             worst[r] = slowest;
+                           });
+
+    auto start = clock_type::now();
+    for (size_t k = 0; k < RELOADS; ++k)
+      publisher.publish_async([&]()
+                              {
+                                return std::unique_ptr<kirkpatrick_refinement>(
+                                  new kirkpatrick_refinement(poly, options.construction));
+                              }).get();
+    stop = true;
+    for (std::thread & thread: threads)
+      thread.join();
+    double elapsed = milliseconds(start, clock_type::now());
+
+    size_t total = std::accumulate(counts.begin(), counts.end(), size_t(0));
+    std::printf("  %zu readers during %zu reloads: %.2f Mq/s, slowest query %.0f ns, "
+                "%zu snapshots unreclaimed, checksum %zu\n",
+                options.readers, RELOADS, total / elapsed / 1000,
+                *std::max_element(worst.begin(), worst.end()), publisher.reclaim(),
+                checksum.load());
+  }
+
+  // the queries through a numa aware executor with a layout per node,
+  // and what every worker did
+  void run_executor(kirkpatrick_refinement const & refinement,
+                    std::vector<point_type> const & queries,
+                    options_type const & options)
+  {
+    executor_options executor_options;
+    executor_options.threads = options.construction.threads;
+    executor_options.numa = true;
+    executor_options.replicate = true;
+    query_executor executor(refinement, executor_options);
+    std::vector<kirkpatrick_refinement::id_type> result(queries.size());
+    auto start = clock_type::now();
+    executor.find_queries(queries.data(), queries.size(), result.data());
+    double batch = milliseconds(start, clock_type::now());
+    std::printf("  executor: %.2f Mq/s on %zu threads over %zu nodes, per thread",
+                queries.size() / batch / 1000, executor.threads_num(), executor.nodes_num());
+    for (auto const & worker: executor.report())
+      std::printf(" %.2f (node %zu, %zu stolen)",
+                  worker.seconds > 0 ? worker.queries / worker.seconds / 1e6 : 0.0,
+                  worker.node, worker.stolen);
+    std::printf("\n");
+  }
+
+  // Small star polygons scattered over the plane in one collection,
+  // queried at random points in the bounding boxes of random polygons.
+  void run_fences(options_type const & options)
+  {
+    const size_t VERTICES = 16;
+    std::mt19937 random(options.seed);
+    std::uniform_int_distribution<int32_t> offset(-(1 << 30), 1 << 30);
+    std::uniform_int_distribution<int> shift(8, 13);
+    std::vector<std::vector<point_type>> polygons(options.fences);
+    for (size_t i = 0; i < polygons.size(); ++i)
+      {
+        polygons[i] = bench::generate_polygon(bench::STAR, VERTICES,
+                                              options.seed + i);
+        int32_t dx = offset(random), dy = offset(random);
+        int s = shift(random);
+        for (point_type & p: polygons[i])
+          p = point_type((p.x >> s) + dx, (p.y >> s) + dy);
+      }
+
+    refinement_collection collection;
+    size_t separate = 0;
+    auto start = clock_type::now();
+    for (auto const & poly: polygons)
+      {
+        kirkpatrick_refinement refinement(poly, options.construction);
+        collection.add(refinement);
+        refinement.compact();
+        separate += refinement.memory_usage();
+      }
+    collection.build_index();
+    double build = milliseconds(start, clock_type::now());
+
+    std::uniform_int_distribution<size_t> which(0, polygons.size() - 1);
+    std::vector<point_type> queries(options.queries);
+    for (point_type & q: queries)
+      {
+        auto const & poly = polygons[which(random)];
+        auto x = std::minmax_element(poly.begin(), poly.end(),
+                                     [](point_type const & l, point_type const & r)
+                                     {
+                                       return l.x < r.x;
+                                     });
+        auto y = std::minmax_element(poly.begin(), poly.end(),
+                                     [](point_type const & l, point_type const & r)
+                                     {
+                                       return l.y < r.y;
+                                     });
+        q = point_type(std::uniform_int_distribution<int32_t>(x.first->x, x.second->x)(random),
+                       std::uniform_int_distribution<int32_t>(y.first->y, y.second->y)(random));
+      }
+    std::vector<size_t> offsets;
+    std::vector<refinement_collection::hit_type> hits;
+    start = clock_type::now();
+    collection.find_containing(queries.data(), queries.size(), offsets, hits);
+    double batch = milliseconds(start, clock_type::now());
+
+    const double MB = 1 << 20;
+    std::printf("fences: %zu polygons of %zu vertices built in %.0f ms, %.1f MB "
+                "(%.1f MB separately compacted), %.2f Mq/s, %.2f hits per query\n",
+                polygons.size(), VERTICES, build, collection.memory_usage() / MB,
+                separate / MB, queries.size() / batch / 1000,
+                double(hits.size()) / queries.size());
+  }
+
+  // Queries a static_dag of refinement, after checking that it answers
+  // a triangle containing each query, or the root as the refinement
+  // does outside it, and the face of the refinement but on edges;
+  // prints its speed and size.
+  template <typename Coord, typename Index, size_t MaxFanout>
+  void run_static_dag(char const * name, kirkpatrick_refinement const & refinement,
+                      std::vector<point_type> const & queries)
+  {
+    typedef static_dag<Coord, Index, MaxFanout> dag_type;
+    if (!dag_type::fits(refinement))
+      {
+        std::printf(", %s does not fit", name);
+        return;
+      }
+    dag_type dag(refinement);
+    size_t faces = 0;
+    for (point_type const & q: queries)
+      {
+        kirkpatrick_refinement::id_type id = dag.find_query(q);
+        if (id == 0 ? refinement.find_query(q) != 0
+            : !refinement.triangle_by_id(id).contains(q))
+          throw std::logic_error(std::string(name) + ": a query missed its triangle");
+        faces += dag.find_face(q) != refinement.find_face(q);
+      }
+
+    size_t checksum = 0;
+    auto start = clock_type::now();
+    for (point_type const & q: queries)
+      checksum += dag.find_query(q);
+    double loop = milliseconds(start, clock_type::now());
+    std::printf(", %s %.1f KB %.2f Mq/s %zu faces on edges (checksum %zu)", name,
+                dag.memory_usage() / 1024.0, queries.size() / loop / 1000, faces,
+                checksum);
+  }
+
+  // Small polygons within the 16-bit range, so both static dags fit,
+  // against their refinements.
+  void run_static(options_type const & options)
+  {
+    const size_t MAX_SIZE = 1000;
+    // the bounding triangle spans about three times the box
+    const int32_t EXTENT = 1 << 13;
+    for (size_t size = options.min_size;
+         size <= std::min(options.max_size, MAX_SIZE); size *= 10)
+      for (bench::shape_type shape: options.shapes)
+        if (size >= bench::min_size(shape))
+          {
+            auto poly = bench::generate_polygon(shape, size, options.seed, EXTENT);
+            kirkpatrick_refinement refinement(poly, options.construction);
+            refinement.compact();
+
+            std::mt19937 random(options.seed);
+            std::uniform_int_distribution<int32_t> coordinate(-EXTENT, EXTENT);
+            std::vector<point_type> queries(options.queries);
+            for (point_type & q: queries)
+              q = point_type(coordinate(random), coordinate(random));
+            size_t checksum = 0;
+            auto start = clock_type::now();
+            for (point_type const & q: queries)
+              checksum += refinement.find_query(q);
+            double loop = milliseconds(start, clock_type::now());
+
+            std::printf("static %s-%zu: refinement %.1f KB %.2f Mq/s (checksum %zu)",
+                        bench::shape_name(shape), size, refinement.memory_usage() / 1024.0,
+                        queries.size() / loop / 1000, checksum);
+            run_static_dag<uint32_t, uint16_t, 16>("<uint32_t, uint16_t, 16>",
+                                                   refinement, queries);
+            run_static_dag<uint16_t, uint16_t, 11>("<uint16_t, uint16_t, 11>",
+                                                   refinement, queries);
+            std::printf("\n");
+          }
+  }
+
+  void run(std::string const & name, std::vector<point_type> const & poly,
+           options_type const & options)
+  {
+    auto x_range = std::minmax_element(poly.begin(), poly.end(),
+                                       [](point_type const & l, point_type const & r)
+                                       {
+                                         return l.x < r.x;
+                                       });
+    auto y_range = std::minmax_element(poly.begin(), poly.end(),
+                                       [](point_type const & l, point_type const & r)
+                                       {
+                                         return l.y < r.y;
+                                       });
+    std::mt19937 random(options.seed);
+    std::uniform_int_distribution<int32_t> x(x_range.first->x, x_range.second->x);
+    std::uniform_int_distribution<int32_t> y(y_range.first->y, y_range.second->y);
+    std::vector<point_type> queries(options.queries);
+    for (point_type & q: queries)
+      q = point_type(x(random), y(random));
+
+    size_t allocations_before = allocations.load();
+    auto start = clock_type::now();
+    kirkpatrick_refinement refinement = options.tune
+      ? kirkpatrick_refinement::tuned(poly, std::vector<point_type>(
+                                        queries.begin(),
+                                        queries.begin() + std::min<size_t>(queries.size(), 10000)),
+                                      options.construction)
+      : kirkpatrick_refinement(poly, options.construction);
+    double build = milliseconds(start, clock_type::now());
+    size_t build_allocations = allocations.load() - allocations_before;
+    double grid = 0;
+    if (options.grid)
+      {
+        start = clock_type::now();
+        refinement.build_grid(options.grid);
+        grid = milliseconds(start, clock_type::now());
+      }
+    size_t rss = peak_rss();
+
+    // the checksum keeps the loop from being optimized away
+    size_t checksum = 0;
+    start = clock_type::now();
+    for (point_type const & q: queries)
+      checksum += refinement.find_query(q);
+    double loop = milliseconds(start, clock_type::now());
+
+    std::vector<kirkpatrick_refinement::id_type> result(queries.size());
+    start = clock_type::now();
+    refinement.find_queries(queries.data(), queries.size(), result.data());
+    double batch = milliseconds(start, clock_type::now());
+    for (auto id: result)
+      checksum -= id;
+    if (checksum != 0)
+      throw std::logic_error(name + ": batch and single queries differ");
+
+    // includes the cost of reading the clock, about 20 ns
+    std::vector<double> latency(std::min(options.latency_samples, queries.size()));
+    for (size_t i = 0; i < latency.size(); ++i)
+      {
+        auto before = clock_type::now();
+        checksum += refinement.find_query(queries[i]);
+        latency[i] = std::chrono::duration<double, std::nano>(clock_type::now() - before).count();
+      }
+    std::sort(latency.begin(), latency.end());
+    auto percentile = [&](double p)
+      {
+        return latency.empty() ? 0 : latency[size_t(p * (latency.size() - 1))];
+      };
+
+    dag_statistics statistics = compute_statistics(refinement);
+    const double MB = 1 << 20;
+    std::printf("%-24s %9zu %9zu %5zu %10.1f %8zu %9.1f %9.1f %9.2f %9.2f %7.0f %7.0f %7.0f %7.0f %7.0f\n",
+                name.c_str(), poly.size(), refinement.triangles_num(),
+                statistics.depth, build, build_allocations, rss / MB,
+                refinement.memory_usage() / MB,
+                queries.size() / loop / 1000, queries.size() / batch / 1000,
+                percentile(0.5), percentile(0.9), percentile(0.99),
+                percentile(0.999), percentile(1));
+    if (options.grid)
+      std::printf("  grid of %zu bytes built in %.1f ms\n", options.grid, grid);
+    if (options.stats)
+      {
+        query_stats queries_stats;
+        for (size_t i = 0; i < latency.size(); ++i)
+          refinement.find_query(queries[i], queries_stats);
+        std::cout << "degree threshold " << refinement.options().degree_threshold
+                  << ", selection " << selection_names[refinement.options().selection] << "\n"
+                  << statistics << queries_stats << std::endl;
+      }
+    if (options.coherent)
+      run_coherent(refinement, poly, queries, options);
+    if (options.classify)
+      run_classify(refinement, poly, options);
+    if (options.raster)
+      run_raster(refinement, poly, options);
+    if (options.updates)
+      run_updates(poly, queries, options);
+    if (options.readers)
+      run_reloads(poly, queries, options);
+    if (options.executor)
+      run_executor(refinement, queries, options);
+    std::fflush(stdout);
+  }
+
+  // what a build and its queries cost, the same on every machine
+  struct regression_row
+  {
+    size_t vertices = 0;
+    size_t triangles = 0;
+    size_t depth = 0;
+    uint64_t hash = 0;
+    double levels = 0;
+    double tests = 0;
+  };
+
+  // relative change of levels or tests per query flagged as a regression
+  const double REGRESSION_TOLERANCE = 0.02;
+
+  regression_row measure(std::vector<point_type> const & poly, options_type const & options)
+  {
+    kirkpatrick_refinement refinement(poly, options.construction);
+    dag_statistics statistics = compute_statistics(refinement);
+    regression_row row;
+    row.vertices = poly.size();
+    row.triangles = refinement.triangles_num();
+    row.depth = statistics.depth;
+    row.hash = statistics.hash;
+
+    // from the raw engine output, as distributions differ between
+    // standard libraries
+    int64_t min_x = poly[0].x, max_x = min_x, min_y = poly[0].y, max_y = min_y;
+    for (point_type const & p: poly)
+      {
+        min_x = std::min<int64_t>(min_x, p.x);
+        max_x = std::max<int64_t>(max_x, p.x);
+        min_y = std::min<int64_t>(min_y, p.y);
+        max_y = std::max<int64_t>(max_y, p.y);
+      }
+    std::mt19937 random(options.seed);
+    query_stats stats;
+    for (size_t i = 0; i < options.queries; ++i)
+      {
+        int64_t x = min_x + int64_t(random() % uint64_t(max_x - min_x + 1));
+        int64_t y = min_y + int64_t(random() % uint64_t(max_y - min_y + 1));
+        refinement.find_query(point_type(int32_t(x), int32_t(y)), stats);
+      }
+    row.levels = stats.average_levels();
+    row.tests = stats.average_tests();
+    return row;
+  }
+
+  std::string regression_settings(options_type const & options)
+  {
+    return "threshold " + std::to_string(options.construction.degree_threshold)
+      + " selection " + selection_names[options.construction.selection]
+      + " seed " + std::to_string(options.construction.seed)
+      + " queries " + std::to_string(options.queries);
+  }
+
+  // Writes the rows of the inputs to options.record, or compares them
+  // with options.check. Returns the exit status, 1 when a row regressed.
+  int run_regression(std::vector<std::string> const & files, options_type const & options)
+  {
+    std::map<std::string, regression_row> rows;
+    for (std::string const & file: files)
+      rows[file.substr(file.find_last_of('/') + 1)] = measure(bench::load_polygon(file), options);
+    const std::string settings = "# " + regression_settings(options);
+
+    if (!options.record.empty())
+      {
+        std::ofstream out(options.record);
+        out << settings << "\n"
+            << "# input vertices triangles depth hash levels tests\n";
+        char line[256];
+        for (auto const & entry: rows)
+          {
+            regression_row const & row = entry.second;
+            std::snprintf(line, sizeof(line), "%s %zu %zu %zu %016llx %.4f %.4f\n",
+                          entry.first.c_str(), row.vertices, row.triangles, row.depth,
+                          (unsigned long long)row.hash, row.levels, row.tests);
+            out << line;
+          }
+        if (!out)
+          throw std::runtime_error("cannot write " + options.record);
+        std::printf("recorded %zu inputs in %s\n", rows.size(), options.record.c_str());
+        return 0;
+      }
+
+    std::ifstream in(options.check);
+    if (!in)
+      throw std::runtime_error("cannot read " + options.check);
+    std::string line;
+    std::getline(in, line);
+    if (line != settings)
+      throw std::runtime_error(options.check + " was recorded with " + line.substr(2)
+                               + ", not " + settings.substr(2));
+    std::map<std::string, regression_row> baseline;
+    while (std::getline(in, line))
+      {
+        if (line.empty() || line[0] == '#')
+          continue;
+        char name[256];
+        unsigned long long hash;
+        regression_row row;
+        if (std::sscanf(line.c_str(), "%255s %zu %zu %zu %llx %lf %lf", name, &row.vertices,
+                        &row.triangles, &row.depth, &hash, &row.levels, &row.tests) != 7)
+          throw std::runtime_error(options.check + ": bad line " + line);
+        row.hash = hash;
+        baseline[name] = row;
+      }
+
+    size_t regressed = 0;
+    for (auto const & entry: rows)
+      {
+        regression_row const & row = entry.second;
+        auto found = baseline.find(entry.first);
+        if (found == baseline.end())
+          {
+            std::printf("%-24s new\n", entry.first.c_str());
+            continue;
+          }
+        regression_row const & old = found->second;
+        bool worse = row.depth > old.depth
+          || row.levels > old.levels * (1 + REGRESSION_TOLERANCE)
+          || row.tests > old.tests * (1 + REGRESSION_TOLERANCE);
+        regressed += worse;
+        std::printf("%-24s %s: triangles %zu (%zu), depth %zu (%zu), levels %.2f (%.2f), "
+                    "tests %.2f (%.2f)\n", entry.first.c_str(),
+                    worse ? "REGRESSED" : row.hash != old.hash ? "changed" : "same",
+                    row.triangles, old.triangles, row.depth, old.depth,
+                    row.levels, old.levels, row.tests, old.tests);
+      }
+    return regressed ? 1 : 0;
+  }
+
+  std::vector<std::string> list_inputs(std::string const & directory)
+  {
+    std::vector<std::string> result;
+    if (DIR * dir = opendir(directory.c_str()))
+      {
+        while (dirent * entry = readdir(dir))
+          {
+            std::string name = entry->d_name;
+            if (name.size() > 5 && name.compare(name.size() - 5, 5, ".test") == 0)
+              result.push_back(directory + "/" + name);
+          }
+        closedir(dir);
+      }
+    std::sort(result.begin(), result.end());
+    return result;
+  }
+
+  void usage(char const * program)
+  {
+    std::cerr << "usage: " << program << " [options] [polygon files]\n"
+              << "  --min N        smallest generated polygon, default 100\n"
+              << "  --max N        largest generated polygon, default 10^7\n"
+              << "  --queries N    queries per polygon, default 10^6\n"
+              << "  --latency N    queries timed one by one, default 10^5\n"
+              << "  --shapes LIST  comma separated convex,star,spiral,comb\n"
+              << "  --seed N       seed of polygons, queries and construction, default 1\n"
+              << "  --threads N    construction, raster and executor threads, default 1\n"
+              << "  --threshold N  degree threshold, default 12\n"
+              << "  --selection S  fifo, lowest_degree, randomized or max_independent\n"
+              << "  --tune         build with the threshold and selection that\n"
+              << "                 answer the first 10^4 queries fastest\n"
+              << "  --input DIR    directory of .test polygons, default input\n"
+              << "  --stats        print dag and query statistics\n"
+              << "  --coherent     locate a track and Hilbert sorted queries\n"
+              << "  --classify     inside tests of queries mostly outside\n"
+              << "  --grid BYTES   start queries from a grid of BYTES\n"
+              << "  --raster N     label an N x N raster over the bounding box\n"
+              << "  --updates N    split N random edges of a dynamic copy\n"
+              << "  --readers N    query from N threads during three reloads\n"
+              << "  --fences N     locate in a collection of N small polygons\n"
+              << "  --executor     batch on --threads workers, a layout per numa node\n"
+              << "  --static       compare static dags of small polygons with their\n"
+              << "                 refinements\n"
+              << "  --record FILE  write depth, dag hash and query cost of the inputs\n"
+              << "  --check FILE   compare the inputs with a recorded baseline, exit 1\n"
+              << "                 when one got deeper or 2% costlier to query\n";
+  }
+
+  options_type parse_options(int argc, char ** argv)
+  {
+    options_type options;
+    for (int i = 1; i < argc; ++i)
+      {
+        std::string arg = argv[i];
+        auto value = [&]() -> std::string
+          {
+            if (i + 1 == argc)
+              throw std::invalid_argument(arg + " needs a value");
+            return argv[++i];
+          };
+        auto number = [&]()
+          {
+            return size_t(std::stoull(value()));
+          };
+
+        if (arg == "--min")
+          options.min_size = std::max<size_t>(1, number());
+        else if (arg == "--max")
+          options.max_size = number();
+        else if (arg == "--queries")
+          options.queries = number();
+        else if (arg == "--latency")
+          options.latency_samples = number();
+        else if (arg == "--seed")
+          options.construction.seed = options.seed = number();
+        else if (arg == "--threads")
+          options.construction.threads = std::max<size_t>(1, number());
+        else if (arg == "--threshold")
+          options.construction.degree_threshold = number();
+        else if (arg == "--selection")
+          {
+            std::string name = value();
+            auto found = std::find(std::begin(selection_names),
+                                   std::end(selection_names), name);
+            if (found == std::end(selection_names))
+              throw std::invalid_argument("unknown selection " + name);
+            options.construction.selection =
+              construction_options::selection_type(found - std::begin(selection_names));
+          }
+        else if (arg == "--tune")
+          options.tune = true;
+        else if (arg == "--stats")
+          options.stats = true;
+        else if (arg == "--coherent")
+          options.coherent = true;
+        else if (arg == "--classify")
+          options.classify = true;
+        else if (arg == "--grid")
+          options.grid = number();
+        else if (arg == "--raster")
+          options.raster = number();
+        else if (arg == "--updates")
+          options.updates = number();
+        else if (arg == "--readers")
+          options.readers = number();
+        else if (arg == "--fences")
+          options.fences = number();
+        else if (arg == "--executor")
+          options.executor = true;
+        else if (arg == "--static")
+          options.static_dags = true;
+        else if (arg == "--record")
+          options.record = value();
+        else if (arg == "--check")
+          options.check = value();
+        else if (arg == "--input")
+          options.input = value();
+        else if (arg == "--shapes")
+          {
+            std::string list = value() + ",";
+            for (size_t from = 0, comma; (comma = list.find(',', from)) != std::string::npos;
+                 from = comma + 1)
+              {
+                bench::shape_type shape;
+                if (!bench::parse_shape(list.substr(from, comma - from), shape))
+                  throw std::invalid_argument("unknown shape in " + list);
+                options.shapes.push_back(shape);
+              }
+          }
+        else if (arg.compare(0, 2, "--") == 0)
+          throw std::invalid_argument("unknown option " + arg);
+        else
+          options.files.push_back(arg);
+      }
+    if (options.shapes.empty())
+      options.shapes.assign(std::begin(bench::SHAPES), std::end(bench::SHAPES));
+    return options;
+  }
+}
+
+int main(int argc, char ** argv)
+{
+  options_type options;
+  try
+    {
+      options = parse_options(argc, argv);
+    }
+  catch (std::exception const & e)
+    {
+      std::cerr << e.what() << "\n";
+      usage(argv[0]);
+      return 2;
+    }
+
+  std::vector<std::string> files = options.files;
+  if (files.empty())
+    files = list_inputs(options.input);
+
+  try
+    {
+      if (!options.record.empty() || !options.check.empty())
+        return run_regression(files, options);
+
+      print_header();
+      for (std::string const & file: files)
+        run(file, bench::load_polygon(file), options);
+      for (size_t size = options.min_size; size <= options.max_size; size *= 10)
+        for (bench::shape_type shape: options.shapes)
+          if (size >= bench::min_size(shape))
+            run(std::string(bench::shape_name(shape)) + "-" + std::to_string(size),
+                bench::generate_polygon(shape, size, options.seed), options);
+      if (options.fences)
+        run_fences(options);
+      if (options.static_dags)
+        run_static(options);
+    }
+  catch (std::exception const & e)
+    {
+      std::cerr << e.what() << "\n";
+      return 1;
+    }
+}
@@ -0,0 +1,220 @@
+#include "polygon_generators.h"
+#include "point_io.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <stdexcept>
+
+namespace bench
+{
+  namespace
+  {
+    const double PI = 3.14159265358979323846;
+
+    point_type polar(double angle, double radius)
+    {
+      return point_type(int32_t(std::lround(radius * std::cos(angle))),
+                        int32_t(std::lround(radius * std::sin(angle))));
+    }
+
+    int64_t cross(point_type const & o, point_type const & a, point_type const & b)
+    {
+      return (int64_t(a.x) - o.x) * (int64_t(b.y) - o.y)
+        - (int64_t(a.y) - o.y) * (int64_t(b.x) - o.x);
+    }
+
+    // drops repeated vertices, including the closing one
+    void remove_duplicates(std::vector<point_type> & poly)
+    {
+      poly.erase(std::unique(poly.begin(), poly.end()), poly.end());
+      while (poly.size() > 1 && poly.front() == poly.back())
+        poly.pop_back();
+    }
+
+    double signed_area(std::vector<point_type> const & poly)
+    {
+      double result = 0;
+      for (size_t i = 0, j = poly.size() - 1; i < poly.size(); j = i++)
+        result += double(poly[j].x) * poly[i].y - double(poly[i].x) * poly[j].y;
+      return result / 2;
+    }
+
+    // rounded points on a circle, reduced to their strictly convex hull
+    std::vector<point_type> convex(size_t size, int32_t extent, std::mt19937 & random)
+    {
+      std::uniform_real_distribution<double> phase(0, 2 * PI / size);
+      double start = phase(random);
+      std::vector<point_type> points;
+      points.reserve(size);
+      for (size_t i = 0; i < size; ++i)
+        points.push_back(polar(start + 2 * PI * i / size, extent));
+      std::sort(points.begin(), points.end());
+      points.erase(std::unique(points.begin(), points.end()), points.end());
+
+      std::vector<point_type> hull(2 * points.size());
+      size_t k = 0;
+      for (size_t i = 0; i < points.size(); ++i)
+        {
+          while (k >= 2 && cross(hull[k - 2], hull[k - 1], points[i]) <= 0)
+            --k;
+          hull[k++] = points[i];
+        }
+      for (size_t i = points.size() - 1, lower = k + 1; i-- > 0;)
+        {
+          while (k >= lower && cross(hull[k - 2], hull[k - 1], points[i]) <= 0)
+            --k;
+          hull[k++] = points[i];
+        }
+      hull.resize(k - 1);
+      return hull;
+    }
+
+    // one vertex per angular sector at a random distance from the center
+    std::vector<point_type> star(size_t size, int32_t extent, std::mt19937 & random)
+    {
+      std::uniform_real_distribution<double> jitter(-0.4, 0.4);
+      std::uniform_real_distribution<double> radius(0.3 * extent, extent);
+      std::vector<point_type> poly;
+      poly.reserve(size);
+      for (size_t i = 0; i < size; ++i)
+        poly.push_back(polar(2 * PI * (i + jitter(random)) / size, radius(random)));
+      return poly;
+    }
+
+    // strip between the archimedean spirals r = s t and r = s (t + pi)
+    std::vector<point_type> spiral(size_t size, int32_t extent, std::mt19937 & random)
+    {
+      // at least eight steps a turn, fewer cross the other side
+      size_t turns = std::max<size_t>(1, std::min<size_t>(std::cbrt(double(size)) / 2,
+                                                          size / 16));
+      std::uniform_real_distribution<double> phase(0, 2 * PI);
+      double rotation = phase(random);
+      double first = 2 * PI;
+      double last = 2 * PI * (turns + 1);
+      size_t steps = std::max<size_t>(2, size / 2) - 1;
+      double scale = extent / (last + PI);
+
+      std::vector<point_type> poly;
+      poly.reserve(size);
+      for (size_t i = 0; i <= steps; ++i)
+        {
+          double t = first + (last - first) * i / steps;
+          poly.push_back(polar(t + rotation, scale * t));
+        }
+      for (size_t i = steps + 1; i-- > 0;)
+        {
+          double t = first + (last - first) * i / steps;
+          poly.push_back(polar(t + rotation, scale * (t + PI)));
+        }
+      return poly;
+    }
+
+    // teeth of random height standing on a common base
+    std::vector<point_type> comb(size_t size, int32_t extent, std::mt19937 & random)
+    {
+      size_t teeth = std::max<size_t>(1, size / 4);
+      int32_t width = std::max<int32_t>(1, extent / int32_t(teeth));
+      int32_t base = extent / 8;
+      std::uniform_int_distribution<int32_t> height(extent / 4, extent);
+
+      auto left = [&](size_t i)
+        {
+          return int32_t(2 * i * width) - extent;
+        };
+      auto right = [&](size_t i)
+        {
+          return left(i) + width;
+        };
+
+      std::vector<point_type> poly;
+      poly.reserve(4 * teeth);
+      poly.push_back(point_type(left(0), -extent));
+      poly.push_back(point_type(right(teeth - 1), -extent));
+      for (size_t i = teeth; i-- > 0;)
+        {
+          int32_t top = height(random) - extent;
+          if (i + 1 != teeth)
+            poly.push_back(point_type(right(i), base - extent));
+          poly.push_back(point_type(right(i), top));
+          poly.push_back(point_type(left(i), top));
+          if (i != 0)
+            poly.push_back(point_type(left(i), base - extent));
+        }
+      return poly;
+    }
+  }
+
+  char const * shape_name(shape_type shape)
+  {
+    switch (shape)
+      {
+      case CONVEX:
+        return "convex";
+      case STAR:
+        return "star";
+      case SPIRAL:
+        return "spiral";
+      case COMB:
+        return "comb";
+      }
+    return "unknown";
+  }
+
+  bool parse_shape(std::string const & name, shape_type & shape)
+  {
+    for (shape_type s: SHAPES)
+      if (name == shape_name(s))
+        {
+          shape = s;
+          return true;
+        }
+    return false;
+  }
+
+  size_t min_size(shape_type shape)
+  {
+    // a single turn of the spiral crosses itself with fewer steps
+    return shape == SPIRAL ? 8 : 3;
+  }
+
+  std::vector<point_type> generate_polygon(shape_type shape, size_t size,
+                                           uint32_t seed, int32_t extent)
+  {
+    if (size < min_size(shape))
+      throw std::invalid_argument(std::string(shape_name(shape)) + " polygons need at least "
+                                  + std::to_string(min_size(shape)) + " vertices");
+    std::mt19937 random(seed);
+    std::vector<point_type> poly;
+    switch (shape)
+      {
+      case CONVEX:
+        poly = convex(size, extent, random);
+        break;
+      case STAR:
+        poly = star(size, extent, random);
+        break;
+      case SPIRAL:
+        poly = spiral(size, extent, random);
+        break;
+      case COMB:
+        poly = comb(size, extent, random);
+        break;
+      }
+    remove_duplicates(poly);
+    if (signed_area(poly) < 0)
+      std::reverse(poly.begin(), poly.end());
+    return poly;
+  }
+
+  std::vector<point_type> load_polygon(std::string const & path)
+  {
+    std::vector<point_type> poly = geom::algorithms::localization::load_points(path);
+    remove_duplicates(poly);
+    if (poly.size() < 3)
+      throw std::runtime_error(path + " holds no polygon");
+    if (signed_area(poly) < 0)
+      std::reverse(poly.begin(), poly.end());
+    return poly;
+  }
+}
@@ -0,0 +1,45 @@
+#ifndef _POLYGON_GENERATORS_H
+#define _POLYGON_GENERATORS_H
+
+#include "geom/primitives/point.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace bench
+{
+  using geom::structures::point_type;
+
+  enum shape_type
+    {
+      CONVEX,
+      STAR,
+      SPIRAL,
+      COMB
+    };
+
+  const shape_type SHAPES[] = {CONVEX, STAR, SPIRAL, COMB};
+
+  // default extent of generated polygons
+  const int32_t EXTENT = 1 << 28;
+
+  char const * shape_name(shape_type shape);
+  bool parse_shape(std::string const & name, shape_type & shape);
+
+  // smallest size generate_polygon accepts for shape
+  size_t min_size(shape_type shape);
+
+  // Random simple counter clockwise polygon of about size vertices
+  // within +-extent. Rounding to the grid may merge vertices, convex
+  // polygons additionally lose the vertices that are no longer strictly
+  // convex. Throws std::invalid_argument below min_size(shape).
+  std::vector<point_type> generate_polygon(shape_type shape, size_t size,
+                                           uint32_t seed, int32_t extent = EXTENT);
+
+  // points in the viewer's "(x, y)" text format or the binary format of
+  // save_points, turned counter clockwise
+  std::vector<point_type> load_polygon(std::string const & path);
+}
+
+#endif // _POLYGON_GENERATORS_H
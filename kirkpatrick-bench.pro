@@ -0,0 +1,22 @@
+TEMPLATE = app
+TARGET = kirkpatrick-bench
+
+CONFIG += console
+CONFIG -= qt app_bundle
+
+OBJECTS_DIR = bin/bench
+
+QMAKE_CXXFLAGS = -std=c++11 -Wall -pedantic -Werror -O3 -pthread
+
+DEPENDPATH += src bench
+INCLUDEPATH += src \
+               bench \
+               visualization/headers \
+
+HEADERS += bench/polygon_generators.h \
+
+SOURCES += bench/main.cpp \
+           bench/polygon_generators.cpp \
+
+LIBS += -Llib -lkirkpatrick-core -pthread
+PRE_TARGETDEPS += lib/libkirkpatrick-core.a
@@ -0,0 +1,14 @@
+TEMPLATE = lib
+TARGET = kirkpatrick-core
+
+CONFIG += staticlib
+CONFIG -= qt
+
+DESTDIR = lib
+OBJECTS_DIR = bin/core
+
+QMAKE_CXXFLAGS = -std=c++11 -Wall -pedantic -Werror -O3 -pthread
+
+INCLUDEPATH += visualization/headers
+
+include(src/kirkpatrick.pri)
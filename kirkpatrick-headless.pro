@@ -0,0 +1,11 @@
+# Core library and benchmark without Qt or OpenGL:
+#   qmake kirkpatrick-headless.pro && make
+#   ./kirkpatrick-bench --max 1000000
+
+TEMPLATE = subdirs
+
+SUBDIRS = core bench
+
+core.file = kirkpatrick-core.pro
+bench.file = kirkpatrick-bench.pro
+bench.depends = core
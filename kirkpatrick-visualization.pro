@@ -6,7 +6,7 @@ QT += opengl
 
 OBJECTS_DIR = bin
 
-QMAKE_CXXFLAGS = -std=c++11 -Wall -pedantic -Werror -Ofast
+QMAKE_CXXFLAGS = -std=c++11 -Wall -pedantic -Werror -O3 -pthread
 
 macx {
     QMAKE_CXXFLAGS += -stdlib=libc++
@@ -27,16 +27,9 @@ INCLUDEPATH += src \
 
 HEADERS += src/stdafx.h \
            src/viewer.h \
-           src/determinant.h \
-           src/circular.h \
-           src/graph.h \
-           src/common.h \
-           src/triangle.h \
-           src/kirkpatrick_refinement.h \
 
 SOURCES += src/main.cpp \
-           src/kirkpatrick_refinement.cpp \
-           src/triangle.cpp \
-           src/turn.cpp \
 
-LIBS += -Lvisualization -lvisualization
+include(src/kirkpatrick.pri)
+
+LIBS += -Lvisualization -lvisualization -pthread
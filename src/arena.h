@@ -0,0 +1,141 @@
+#ifndef _ARENA_H
+#define _ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+namespace geom
+{
+  namespace structures
+  {
+    // Bump allocator for data built once and dropped at once. Blocks
+    // double in size, so n allocations cost O(log n) heap allocations;
+    // memory is only given back by release and the destructor. Not
+    // thread safe.
+    struct monotonic_arena
+    {
+      explicit monotonic_arena(size_t first_block = 4096)
+        : next_size_(first_block)
+      {}
+
+      ~monotonic_arena()
+      {
+        for (char * block: blocks_)
+          ::operator delete(block);
+      }
+
+      monotonic_arena(monotonic_arena const &) = delete;
+      monotonic_arena & operator =(monotonic_arena const &) = delete;
+
+      void * allocate(size_t size, size_t align)
+      {
+        uintptr_t at = (uintptr_t(cursor_) + align - 1) & ~uintptr_t(align - 1);
+        if (!cursor_ || at + size > uintptr_t(end_))
+          {
+            while (next_size_ < size + align)
+              next_size_ *= 2;
+            add_block(next_size_);
+            next_size_ *= 2;
+            at = (uintptr_t(cursor_) + align - 1) & ~uintptr_t(align - 1);
+          }
+        cursor_ = reinterpret_cast<char *>(at + size);
+        return reinterpret_cast<void *>(at);
+      }
+
+      // forgets every allocation, keeps the largest block for the next ones
+      void release()
+      {
+        if (blocks_.empty())
+          return;
+        for (size_t i = 0; i + 1 < blocks_.size(); ++i)
+          ::operator delete(blocks_[i]);
+        blocks_.front() = blocks_.back();
+        blocks_.resize(1);
+        cursor_ = blocks_.front();
+        end_ = cursor_ + last_size_;
+        capacity_ = last_size_;
+      }
+
+      // bytes taken from the heap
+      size_t capacity() const
+      {
+        return capacity_;
+      }
+
+    private:
+      void add_block(size_t size)
+      {
+        blocks_.push_back(static_cast<char *>(::operator new(size)));
+        cursor_ = blocks_.back();
+        end_ = cursor_ + size;
+        last_size_ = size;
+        capacity_ += size;
+      }
+
+    private:
+      std::vector<char *> blocks_;
+      char * cursor_ = nullptr;
+      char * end_ = nullptr;
+      size_t next_size_;
+      size_t last_size_ = 0;
+      size_t capacity_ = 0;
+    };
+
+    // Standard allocator over a monotonic_arena; deallocation is a no-op.
+    // Without an arena it falls back to the heap, and copies of containers
+    // get no arena, so they do not depend on the lifetime of the original.
+    template <typename T>
+    struct arena_allocator
+    {
+      typedef T value_type;
+      typedef std::true_type propagate_on_container_move_assignment;
+      typedef std::true_type propagate_on_container_swap;
+
+      arena_allocator(monotonic_arena * arena = nullptr)
+        : arena(arena)
+      {}
+
+      template <typename U>
+      arena_allocator(arena_allocator<U> const & other)
+        : arena(other.arena)
+      {}
+
+      T * allocate(size_t n)
+      {
+        if (!arena)
+          return static_cast<T *>(::operator new(n * sizeof(T)));
+        return static_cast<T *>(arena->allocate(n * sizeof(T), alignof(T)));
+      }
+
+      void deallocate(T * p, size_t)
+      {
+        if (!arena)
+          ::operator delete(p);
+      }
+
+      arena_allocator select_on_container_copy_construction() const
+      {
+        return arena_allocator();
+      }
+
+      monotonic_arena * arena;
+    };
+
+    template <typename T, typename U>
+    bool operator ==(arena_allocator<T> const & l, arena_allocator<U> const & r)
+    {
+      return l.arena == r.arena;
+    }
+
+    template <typename T, typename U>
+    bool operator !=(arena_allocator<T> const & l, arena_allocator<U> const & r)
+    {
+      return l.arena != r.arena;
+    }
+  }
+}
+
+#endif // _ARENA_H
@@ -3,10 +3,10 @@
 
 #include <list>
 
-template <typename T>
-typename std::list<T>::iterator
-next(typename std::list<T>::iterator iter,
-     std::list<T> & container)
+template <typename T, typename Allocator>
+typename std::list<T, Allocator>::iterator
+next(typename std::list<T, Allocator>::iterator iter,
+     std::list<T, Allocator> & container)
 {
     auto result = std::next(iter);
     if (result == container.end())
@@ -14,10 +14,10 @@ next(typename std::list<T>::iterator iter,
     return result;
 }
 
-template <typename T>
-typename std::list<T>::iterator
-prev(typename std::list<T>::iterator iter,
-     std::list<T> & container)
+template <typename T, typename Allocator>
+typename std::list<T, Allocator>::iterator
+prev(typename std::list<T, Allocator>::iterator iter,
+     std::list<T, Allocator> & container)
 {
     if (iter == container.begin())
         return std::prev(container.end());
@@ -0,0 +1,160 @@
+#include "dag_statistics.h"
+
+#include <algorithm>
+#include <ostream>
+
+namespace geom
+{
+  namespace algorithms
+  {
+    namespace localization
+    {
+      namespace
+      {
+        // 64-bit FNV-1a over little endian 32-bit words
+        struct fnv_hash
+        {
+          uint64_t value = 14695981039346656037ull;
+
+          void add(uint32_t word)
+          {
+            for (size_t i = 0; i < 4; ++i)
+              {
+                value ^= (word >> (8 * i)) & 0xff;
+                value *= 1099511628211ull;
+              }
+          }
+        };
+
+        uint64_t layout_hash(query_layout const & layout)
+        {
+          auto const & data = layout.data();
+          fnv_hash hash;
+          for (wide_point_type const & p: data.root)
+            {
+              hash.add(uint32_t(p.x));
+              hash.add(uint32_t(p.y));
+            }
+          for (id_type node = 0; node < layout.nodes_num(); ++node)
+            {
+              hash.add(layout.original_id(node));
+              hash.add(layout.children_num(node));
+              for (uint32_t b = data.offsets[node]; b != data.offsets[node + 1]; ++b)
+                {
+                  child_block const & block = data.blocks[b];
+                  for (uint32_t i = 0; i < block.size; ++i)
+                    {
+                      hash.add(layout.original_id(block.id[i]));
+                      int32_t const corners[] = {block.ax[i], block.ay[i], block.bx[i],
+                                                 block.by[i], block.cx[i], block.cy[i]};
+                      for (int32_t c: corners)
+                        hash.add(uint32_t(c));
+                    }
+                }
+            }
+          return hash.value;
+        }
+      }
+
+      dag_statistics compute_statistics(query_layout const & layout)
+      {
+        auto const & data = layout.data();
+        const size_t n = layout.nodes_num();
+        auto children = [&](id_type node, size_t i)
+          {
+            return data.blocks[data.offsets[node] + i / child_block::WIDTH]
+              .id[i % child_block::WIDTH];
+          };
+
+        dag_statistics result;
+        result.triangles = n;
+        result.memory_usage = layout.memory_usage();
+
+        std::vector<size_t> degrees(n);
+        for (id_type node = 0; node < n; ++node)
+          {
+            degrees[node] = layout.children_num(node);
+            result.edges += degrees[node];
+            result.leaves += degrees[node] == 0;
+            if (result.out_degrees.size() <= degrees[node])
+              result.out_degrees.resize(degrees[node] + 1);
+            ++result.out_degrees[degrees[node]];
+          }
+
+        // nodes are numbered breadth-first, so the first leaf is the closest
+        std::vector<size_t> distance(n, 0);
+        for (id_type node = 0; node < n; ++node)
+          {
+            if (degrees[node] == 0)
+              {
+                result.min_depth = distance[node];
+                break;
+              }
+            for (size_t i = 0; i < degrees[node]; ++i)
+              if (distance[children(node, i)] == 0)
+                distance[children(node, i)] = distance[node] + 1;
+          }
+
+        // longest path by a depth first search with memorized heights
+        const size_t unknown = size_t(-1);
+        std::vector<size_t> height(n, unknown);
+        std::vector<std::pair<id_type, size_t>> stack(1, std::make_pair(0, 0));
+        while (!stack.empty())
+          {
+            id_type node = stack.back().first;
+            size_t next = stack.back().second++;
+            if (next < degrees[node])
+              {
+                id_type child = children(node, next);
+                if (height[child] == unknown)
+                  stack.emplace_back(child, 0);
+                continue;
+              }
+            height[node] = 0;
+            for (size_t i = 0; i < degrees[node]; ++i)
+              height[node] = std::max(height[node], height[children(node, i)] + 1);
+            stack.pop_back();
+          }
+        result.depth = height[0];
+        result.hash = layout_hash(layout);
+        return result;
+      }
+
+      dag_statistics compute_statistics(kirkpatrick_refinement const & refinement)
+      {
+        dag_statistics result = compute_statistics(refinement.layout());
+        result.memory_usage = refinement.memory_usage();
+        size_t first = 0;
+        for (size_t end: refinement.level_ends())
+          {
+            result.level_triangles.push_back(end - first);
+            first = end;
+          }
+        return result;
+      }
+
+      std::ostream & operator <<(std::ostream & out, dag_statistics const & stats)
+      {
+        out << "triangles " << stats.triangles
+            << ", leaves " << stats.leaves
+            << ", edges " << stats.edges
+            << ", depth " << stats.min_depth << " to " << stats.depth
+            << ", " << stats.memory_usage << " bytes"
+            << ", hash " << std::hex << stats.hash << std::dec << "\n";
+        out << "triangles by children:";
+        for (size_t i = 0; i < stats.out_degrees.size(); ++i)
+          if (stats.out_degrees[i] != 0)
+            out << " " << i << ":" << stats.out_degrees[i];
+        out << "\n";
+        if (!stats.level_triangles.empty())
+          {
+            out << "triangles by level:";
+            for (size_t count: stats.level_triangles)
+              out << " " << count;
+            out << "\n";
+          }
+        return out;
+      }
+    }
+  }
+}
@@ -0,0 +1,46 @@
+#ifndef _DAG_STATISTICS_H
+#define _DAG_STATISTICS_H
+
+#include "kirkpatrick_refinement.h"
+#include "query_layout.h"
+
+#include <iosfwd>
+#include <vector>
+
+namespace geom
+{
+  namespace algorithms
+  {
+    namespace localization
+    {
+      // Shape of a built search dag, to check the logarithmic depth and
+      // the bounded fan-out on real inputs.
+      struct dag_statistics
+      {
+        size_t triangles = 0;
+        size_t leaves = 0;
+        size_t edges = 0;
+        // edges on the longest and the shortest root to leaf path
+        size_t depth = 0;
+        size_t min_depth = 0;
+        // number of triangles by their number of children
+        std::vector<size_t> out_degrees;
+        // triangles added by each construction level, when known
+        std::vector<size_t> level_triangles;
+        size_t memory_usage = 0;
+        // FNV-1a over the root, and the original id, children and child
+        // corners of every node in layout order; equal builds hash
+        // equally on every platform, compacted, mapped or not
+        uint64_t hash = 0;
+      };
+
+      // works on compacted structures and mapped files as well
+      dag_statistics compute_statistics(query_layout const & layout);
+      dag_statistics compute_statistics(kirkpatrick_refinement const & refinement);
+
+      std::ostream & operator <<(std::ostream & out, dag_statistics const & stats);
+    }
+  }
+}
+
+#endif // _DAG_STATISTICS_H
@@ -0,0 +1,654 @@
+#include "dynamic_refinement.h"
+#include "turn.h"
+#include "polygon_triangulation.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <stdexcept>
+
+namespace geom
+{
+  namespace algorithms
+  {
+    namespace localization
+    {
+      namespace
+      {
+        const kirkpatrick_refinement::id_type NONE = kirkpatrick_refinement::NO_FACE;
+
+        bool separates(wide_point_type const & a, wide_point_type const & b,
+                       triangle_type<wide_point_type> const & t)
+        {
+          return turn(a, b, t.a) <= 0 && turn(a, b, t.b) <= 0 && turn(a, b, t.c) <= 0;
+        }
+
+        // interiors intersect, exactly; two triangles are disjoint iff a
+        // line through an edge separates them
+        bool overlap(triangle_type<wide_point_type> const & l, triangle_type<wide_point_type> const & r)
+        {
+          return !(separates(l.a, l.b, r) || separates(l.b, l.c, r) || separates(l.c, l.a, r)
+                   || separates(r.a, r.b, l) || separates(r.b, r.c, l) || separates(r.c, r.a, l));
+        }
+
+        bool on_segment(wide_point_type const & a, wide_point_type const & b, wide_point_type const & p)
+        {
+          return turn(a, b, p) == 0
+            && std::min(a.x, b.x) <= p.x && p.x <= std::max(a.x, b.x)
+            && std::min(a.y, b.y) <= p.y && p.y <= std::max(a.y, b.y);
+        }
+
+        bool cross(wide_point_type const & a, wide_point_type const & b,
+                   wide_point_type const & c, wide_point_type const & d)
+        {
+          return turn(a, b, c) * turn(a, b, d) < 0 && turn(c, d, a) * turn(c, d, b) < 0;
+        }
+
+        double area(std::vector<wide_point_type> const & points,
+                    std::vector<kirkpatrick_refinement::id_type> const & poly)
+        {
+          double result = 0;
+          for (size_t i = 0, j = poly.size() - 1; i < poly.size(); j = i++)
+            result += double(points[poly[j]].x) * points[poly[i]].y
+              - double(points[poly[i]].x) * points[poly[j]].y;
+          return result / 2;
+        }
+
+        // the other two vertices of t, counter clockwise after v
+        void opposite(triangle_type<kirkpatrick_refinement::id_type> const & t,
+                      kirkpatrick_refinement::id_type v,
+                      kirkpatrick_refinement::id_type & x,
+                      kirkpatrick_refinement::id_type & y)
+        {
+          if (t.a == v)
+            x = t.b, y = t.c;
+          else if (t.b == v)
+            x = t.c, y = t.a;
+          else
+            x = t.a, y = t.b;
+        }
+
+        // change of a face ring; applying it again undoes it
+        struct ring_edit
+        {
+          enum kind_type
+            {
+              INSERT,
+              ERASE,
+              SET
+            };
+
+          kind_type kind;
+          kirkpatrick_refinement::id_type face;
+          size_t position;
+          kirkpatrick_refinement::id_type value;
+
+          void apply(std::vector<kirkpatrick_refinement::id_type> & ring)
+          {
+            switch (kind)
+              {
+              case INSERT:
+                ring.insert(ring.begin() + position, value);
+                kind = ERASE;
+                break;
+              case ERASE:
+                ring.erase(ring.begin() + position);
+                kind = INSERT;
+                break;
+              case SET:
+                std::swap(ring[position], value);
+                break;
+              }
+          }
+        };
+
+        size_t position(std::vector<kirkpatrick_refinement::id_type> const & ring,
+                        kirkpatrick_refinement::id_type v)
+        {
+          size_t result = std::find(ring.begin(), ring.end(), v) - ring.begin();
+          if (result == ring.size())
+            throw std::logic_error("dynamic_refinement: faces out of sync");
+          return result;
+        }
+      }
+
+      dynamic_refinement::dynamic_refinement(std::vector<point_type> const & points,
+                                             std::vector<std::vector<id_type>> const & faces,
+                                             dynamic_options const & options)
+        : options_(options)
+      {
+        reset(build(std::vector<wide_point_type>(points.begin(), points.end()),
+                    faces, options_.construction));
+      }
+
+      dynamic_refinement::~dynamic_refinement()
+      {
+        // the future of a running rebuild waits for it
+      }
+
+      std::unique_ptr<dynamic_refinement::state_type>
+      dynamic_refinement::build(std::vector<wide_point_type> points,
+                                std::vector<std::vector<id_type>> faces,
+                                construction_options const & options)
+      {
+        // only the points on faces, in order of appearance
+        std::vector<id_type> renumbered(points.size(), NONE);
+        // faces never reach the bounding triangle, so every used point
+        // is an input point
+        std::vector<point_type> used;
+        for (auto & face: faces)
+          for (id_type & v: face)
+            {
+              if (v >= points.size())
+                throw std::invalid_argument("dynamic_refinement: face vertex out of range");
+              if (renumbered[v] == NONE)
+                {
+                  renumbered[v] = used.size();
+                  used.push_back(point_type(int32_t(points[v].x), int32_t(points[v].y)));
+                }
+              v = renumbered[v];
+            }
+
+        std::unique_ptr<state_type> state(new state_type);
+        state->base.reset(new kirkpatrick_refinement(std::move(used), faces, options));
+        state->base->compact();
+        state->faces = std::move(faces);
+
+        // leaves are the triangles of level 0 but the root
+        kirkpatrick_refinement const & base = *state->base;
+        const size_t leaves_end = base.level_ends()[0];
+        auto & offsets = state->leaf_offsets;
+        offsets.assign(base.points().size() + 3 + 1, 0);
+        for (id_type id = 1; id < leaves_end; ++id)
+          {
+            auto const & t = base.search_dag().vertices[id];
+            ++offsets[t.a + 1];
+            ++offsets[t.b + 1];
+            ++offsets[t.c + 1];
+          }
+        for (size_t i = 1; i < offsets.size(); ++i)
+          offsets[i] += offsets[i - 1];
+        std::vector<uint32_t> next(offsets.begin(), offsets.end() - 1);
+        state->leaves.resize(offsets.back());
+        for (id_type id = 1; id < leaves_end; ++id)
+          {
+            auto const & t = base.search_dag().vertices[id];
+            state->leaves[next[t.a]++] = id;
+            state->leaves[next[t.b]++] = id;
+            state->leaves[next[t.c]++] = id;
+          }
+        return state;
+      }
+
+      void dynamic_refinement::reset(std::unique_ptr<state_type> state)
+      {
+        base_ = std::move(state->base);
+        base_triangles_num_ = base_->triangles_num();
+        points_ = base_->vertices();
+        faces_ = std::move(state->faces);
+        leaf_offsets_ = std::move(state->leaf_offsets);
+        leaves_ = std::move(state->leaves);
+        changed_leaves_.clear();
+
+        overlay_.clear();
+        overlay_faces_.clear();
+        overlay_depths_.clear();
+        overlay_depth_ = 0;
+        refined_.assign(base_triangles_num_, false);
+        children_.clear();
+      }
+
+      void dynamic_refinement::insert_vertex(id_type face, size_t i, point_type const & point)
+      {
+        perform(update_type{update_type::INSERT, face, i, point});
+      }
+
+      void dynamic_refinement::remove_vertex(id_type face, size_t i)
+      {
+        perform(update_type{update_type::REMOVE, face, i, point_type()});
+      }
+
+      void dynamic_refinement::move_vertex(id_type face, size_t i, point_type const & point)
+      {
+        perform(update_type{update_type::MOVE, face, i, point});
+      }
+
+      void dynamic_refinement::perform(update_type const & update)
+      {
+        poll_rebuild();
+        apply(update);
+        if (rebuild_.valid())
+          journal_.push_back(update);
+        check_rebuild();
+      }
+
+      void dynamic_refinement::apply(update_type const & update)
+      {
+        const id_type f = update.face;
+        if (f >= faces_.size() || update.index >= faces_[f].size())
+          throw std::invalid_argument("dynamic_refinement: no such vertex");
+        std::vector<id_type> const & ring = faces_[f];
+        const size_t size = ring.size();
+        const size_t i = update.index;
+        const id_type v = ring[i];
+        // id of the new point of insertions and moves
+        const id_type q = points_.size();
+        const wide_point_type p = update.point;
+
+        // leaves to replace and the triangles replacing them
+        std::vector<id_type> old_triangles;
+        std::vector<triangle_type<id_type>> triangles;
+        std::vector<id_type> faces;
+        std::vector<ring_edit> edits;
+        // old boundary paths closed by the new ones
+        std::vector<std::vector<id_type>> loops;
+        bool local = true;
+
+        switch (update.kind)
+          {
+          case update_type::INSERT:
+            {
+              const id_type a = v, b = ring[(i + 1) % size];
+              // triangle (a, b, c) of face f and (b, a, d) across the edge
+              std::vector<id_type> around;
+              leaves(a, around);
+              id_type left = NONE, right = NONE, c = NONE, d = NONE;
+              for (id_type t: around)
+                {
+                  id_type x, y;
+                  opposite(triangle(t), a, x, y);
+                  if (x == b)
+                    left = t, c = y;
+                  if (y == b)
+                    right = t, d = x;
+                }
+              if (left == NONE || right == NONE)
+                throw std::logic_error("dynamic_refinement: face edge missing "
+                                       "from the triangulation");
+              const id_type g = face_of(right);
+
+              wide_point_type const & pa = points_[a], & pb = points_[b];
+              wide_point_type const & pc = points_[c], & pd = points_[d];
+              const int ab = turn(pa, pb, p), bc = turn(pb, pc, p), ca = turn(pc, pa, p);
+              const int ad = turn(pa, pd, p), db = turn(pd, pb, p);
+              // both triangles split at point when it sees c and d,
+              // otherwise the one holding it, which leaves a sliver
+              if (bc > 0 && ca > 0 && ad > 0 && db > 0)
+                {
+                  old_triangles = {left, right};
+                  triangles = {{a, q, c}, {q, b, c}, {b, q, d}, {q, a, d}};
+                  faces = {f, f, g, g};
+                }
+              else if (ab > 0 && bc > 0 && ca > 0)
+                {
+                  old_triangles = {left};
+                  triangles = {{a, b, q}, {b, c, q}, {c, a, q}};
+                  faces = {g, f, f};
+                }
+              else if (ab < 0 && ad > 0 && db > 0)
+                {
+                  old_triangles = {right};
+                  triangles = {{b, a, q}, {a, d, q}, {d, b, q}};
+                  faces = {f, g, g};
+                }
+              else
+                local = false;
+
+              loops.push_back({a, q, b});
+              edits.push_back({ring_edit::INSERT, f, i + 1, q});
+              if (g != NONE)
+                edits.push_back({ring_edit::INSERT, g, position(faces_[g], a), q});
+            }
+            break;
+
+          case update_type::REMOVE:
+            {
+              if (size <= 3)
+                throw std::invalid_argument("dynamic_refinement: face would have "
+                                            "less than three vertices");
+              const id_type u = ring[(i + size - 1) % size], w = ring[(i + 1) % size];
+              std::vector<id_type> link;
+              star(v, link, old_triangles);
+              const size_t k = link.size();
+              const size_t ju = position(link, u), jw = position(link, w);
+
+              // face f lies counter clockwise from w to u around v, the
+              // face across both edges from u to w
+              const id_type g = face_of(old_triangles[ju]);
+              std::vector<id_type> piece_f, piece_g;
+              for (size_t j = jw; j != ju; j = (j + 1) % k)
+                {
+                  if (face_of(old_triangles[j]) != f)
+                    throw std::logic_error("dynamic_refinement: faces out of sync");
+                  piece_f.push_back(link[j]);
+                }
+              piece_f.push_back(u);
+              for (size_t j = ju; j != jw; j = (j + 1) % k)
+                {
+                  if (face_of(old_triangles[j]) != g)
+                    throw std::invalid_argument("dynamic_refinement: vertex lies "
+                                                "on more than two faces");
+                  piece_g.push_back(link[j]);
+                }
+              piece_g.push_back(w);
+              if (g != NONE && faces_[g].size() <= 3)
+                throw std::invalid_argument("dynamic_refinement: face would have "
+                                            "less than three vertices");
+
+              // the new edge (u, w) has to stay inside the star
+              for (size_t j = 0; j < k && local; ++j)
+                {
+                  id_type x = link[j], y = link[(j + 1) % k];
+                  if (x != u && x != w && on_segment(points_[u], points_[w], points_[x]))
+                    local = false;
+                  if (x != u && x != w && y != u && y != w
+                      && cross(points_[u], points_[w], points_[x], points_[y]))
+                    local = false;
+                }
+              for (auto const * piece: {&piece_f, &piece_g})
+                if (local && piece->size() > 2)
+                  {
+                    if (area(points_, *piece) <= 0
+                        || !triangulation::triangulate_polygon(points_, *piece, triangles))
+                      local = false;
+                    faces.resize(triangles.size(), piece == &piece_f ? f : g);
+                  }
+
+              loops.push_back({u, w, v});
+              edits.push_back({ring_edit::ERASE, f, i, v});
+              if (g != NONE)
+                edits.push_back({ring_edit::ERASE, g, position(faces_[g], v), v});
+            }
+            break;
+
+          case update_type::MOVE:
+            {
+              std::vector<id_type> link;
+              star(v, link, old_triangles);
+              for (size_t j = 0; j < link.size(); ++j)
+                {
+                  id_type x = link[j], y = link[(j + 1) % link.size()];
+                  if (turn(points_[x], points_[y], p) <= 0)
+                    local = false;
+                  triangles.emplace_back(q, x, y);
+                  faces.push_back(face_of(old_triangles[j]));
+                }
+
+              for (id_type g: faces)
+                if (g != NONE
+                    && std::find_if(edits.begin(), edits.end(),
+                                    [&](ring_edit const & e)
+                                    {
+                                      return e.face == g;
+                                    }) == edits.end())
+                  {
+                    auto const & other = faces_[g];
+                    const size_t j = position(other, v);
+                    edits.push_back({ring_edit::SET, g, j, q});
+                    loops.push_back({other[(j + other.size() - 1) % other.size()], q,
+                                     other[(j + 1) % other.size()], v});
+                  }
+            }
+            break;
+          }
+
+        if (update.kind != update_type::REMOVE)
+          points_.push_back(p);
+        for (ring_edit & e: edits)
+          e.apply(faces_[e.face]);
+
+        if (local)
+          {
+            replace(old_triangles, triangles, faces);
+            return;
+          }
+        try
+          {
+            if (!is_planar(loops, update.kind == update_type::INSERT ? NONE : v,
+                           update.kind == update_type::REMOVE ? NONE : q))
+              throw std::invalid_argument("dynamic_refinement: faces would overlap");
+            rebuild_now();
+          }
+        catch (...)
+          {
+            for (auto e = edits.rbegin(); e != edits.rend(); ++e)
+              e->apply(faces_[e->face]);
+            if (update.kind != update_type::REMOVE)
+              points_.pop_back();
+            throw;
+          }
+      }
+
+      bool dynamic_refinement::is_planar(std::vector<std::vector<id_type>> const & loops,
+                                         id_type gone, id_type q) const
+      {
+        // A vertex changes faces iff a loop winds around it; an edge can
+        // only cross the new edges, the loop sides not at gone.
+        for (auto const & ring: faces_)
+          {
+            if (area(points_, ring) <= 0)
+              return false;
+            for (size_t j = 0; j < ring.size(); ++j)
+              {
+                const id_type x = ring[j], y = ring[(j + 1) % ring.size()];
+                wide_point_type const & px = points_[x], & py = points_[y];
+                if (q != NONE && x != q && y != q && on_segment(px, py, points_[q]))
+                  return false;
+                for (auto const & loop: loops)
+                  {
+                    const bool on_loop = std::find(loop.begin(), loop.end(), x) != loop.end();
+                    int winding = 0;
+                    for (size_t k = 0; k < loop.size(); ++k)
+                      {
+                        const id_type s = loop[k], e = loop[(k + 1) % loop.size()];
+                        wide_point_type const & ps = points_[s], & pe = points_[e];
+                        if (s != gone && e != gone && cross(ps, pe, px, py))
+                          return false;
+                        if (on_loop)
+                          continue;
+                        if (on_segment(ps, pe, px))
+                          return false;
+                        if (ps.y <= px.y)
+                          winding += pe.y > px.y && turn(ps, pe, px) > 0;
+                        else
+                          winding -= pe.y <= px.y && turn(ps, pe, px) < 0;
+                      }
+                    if (winding != 0)
+                      return false;
+                  }
+              }
+          }
+        return true;
+      }
+
+      void dynamic_refinement::rebuild_now()
+      {
+        std::unique_ptr<state_type> state = build(points_, faces_, options_.construction);
+        // A running rebuild is older, so its result is discarded, but
+        // only once it finishes: the future of std::async waits for it.
+        // It ran alongside the build above, so the wait is its remainder.
+        if (rebuild_.valid())
+          rebuild_.wait();
+        rebuild_ = std::future<std::unique_ptr<state_type>>();
+        journal_.clear();
+        reset(std::move(state));
+        ++rebuilds_num_;
+      }
+
+      void dynamic_refinement::check_rebuild()
+      {
+        if (rebuild_.valid()
+            || (overlay_.size() <= options_.rebuild_ratio * base_triangles_num_
+                && overlay_depth_ <= options_.max_overlay_depth))
+          return;
+        if (!options_.background)
+          {
+            rebuild_now();
+            return;
+          }
+        journal_.clear();
+        rebuild_ = std::async(std::launch::async, &dynamic_refinement::build,
+                              points_, faces_, options_.construction);
+      }
+
+      void dynamic_refinement::poll_rebuild()
+      {
+        if (!rebuild_.valid()
+            || rebuild_.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+          return;
+        std::unique_ptr<state_type> state = rebuild_.get();
+        std::vector<update_type> journal;
+        journal.swap(journal_);
+        reset(std::move(state));
+        ++rebuilds_num_;
+        // the updates were valid on the snapshot, so replay cannot throw
+        for (update_type const & update: journal)
+          apply(update);
+        check_rebuild();
+      }
+
+      void dynamic_refinement::wait_rebuild()
+      {
+        if (rebuild_.valid())
+          {
+            rebuild_.wait();
+            poll_rebuild();
+          }
+      }
+
+      dynamic_refinement::id_type
+      dynamic_refinement::locate(point_type const & point, id_type from) const
+      {
+        id_type id = from;
+        while (refined_[id])
+          {
+            auto const & children = children_.find(id)->second;
+            size_t i = 0;
+            for (; i < children.size(); ++i)
+              {
+                auto const & t = triangle(children[i]);
+                if (triangle_type<wide_point_type>(points_[t.a], points_[t.b], points_[t.c])
+                    .contains(point))
+                  break;
+              }
+            if (i == children.size())
+              break;
+            id = children[i];
+          }
+        return id;
+      }
+
+      dynamic_refinement::id_type
+      dynamic_refinement::find_face(point_type const & point) const
+      {
+        return face_of(locate(point, base_->find_query(point)));
+      }
+
+      void dynamic_refinement::find_faces(point_type const * points, size_t count,
+                                          id_type * result) const
+      {
+        base_->find_queries(points, count, result);
+        for (size_t i = 0; i < count; ++i)
+          result[i] = face_of(locate(points[i], result[i]));
+      }
+
+      void dynamic_refinement::leaves(id_type v, std::vector<id_type> & result) const
+      {
+        auto changed = changed_leaves_.find(v);
+        if (changed != changed_leaves_.end())
+          result = changed->second;
+        else if (v + 1 < leaf_offsets_.size())
+          result.assign(leaves_.begin() + leaf_offsets_[v], leaves_.begin() + leaf_offsets_[v + 1]);
+        else
+          result.clear();
+      }
+
+      void dynamic_refinement::star(id_type v, std::vector<id_type> & link,
+                                    std::vector<id_type> & triangles) const
+      {
+        std::vector<id_type> around;
+        leaves(v, around);
+        link.clear();
+        triangles.clear();
+        if (around.empty())
+          throw std::logic_error("dynamic_refinement: vertex missing from the triangulation");
+
+        // every leaf (v, x, y) continues the link from x to y
+        id_type x, y;
+        opposite(triangle(around[0]), v, x, y);
+        link.push_back(x);
+        triangles.push_back(around[0]);
+        while (y != link[0])
+          {
+            if (link.size() == around.size())
+              throw std::logic_error("dynamic_refinement: star of a vertex is not closed");
+            id_type from = y;
+            auto next = std::find_if(around.begin(), around.end(),
+                                     [&](id_type t)
+                                     {
+                                       opposite(triangle(t), v, x, y);
+                                       return x == from;
+                                     });
+            if (next == around.end())
+              throw std::logic_error("dynamic_refinement: star of a vertex is not closed");
+            opposite(triangle(*next), v, x, y);
+            link.push_back(x);
+            triangles.push_back(*next);
+          }
+      }
+
+      void dynamic_refinement::replace(std::vector<id_type> const & old_triangles,
+                                       std::vector<triangle_type<id_type>> const & triangles,
+                                       std::vector<id_type> const & faces)
+      {
+        assert(triangles.size() == faces.size());
+        const id_type first = base_triangles_num_ + overlay_.size();
+        overlay_.insert(overlay_.end(), triangles.begin(), triangles.end());
+        overlay_faces_.insert(overlay_faces_.end(), faces.begin(), faces.end());
+        overlay_depths_.resize(overlay_.size(), 0);
+        refined_.resize(base_triangles_num_ + overlay_.size(), false);
+
+        auto geometry = [&](triangle_type<id_type> const & t)
+          {
+            return triangle_type<wide_point_type>(points_[t.a], points_[t.b], points_[t.c]);
+          };
+        for (id_type old: old_triangles)
+          {
+            refined_[old] = true;
+            const uint32_t depth = old < base_triangles_num_
+              ? 0 : overlay_depths_[old - base_triangles_num_];
+            auto & children = children_[old];
+            auto old_geometry = geometry(triangle(old));
+            for (size_t k = 0; k < triangles.size(); ++k)
+              if (overlap(old_geometry, geometry(triangles[k])))
+                {
+                  children.push_back(first + k);
+                  uint32_t & child_depth = overlay_depths_[first + k - base_triangles_num_];
+                  child_depth = std::max(child_depth, depth + 1);
+                  overlay_depth_ = std::max<size_t>(overlay_depth_, child_depth);
+                }
+            assert(!children.empty());
+          }
+
+        auto changed = [&](id_type v) -> std::vector<id_type> &
+          {
+            auto found = changed_leaves_.find(v);
+            if (found != changed_leaves_.end())
+              return found->second;
+            std::vector<id_type> around;
+            leaves(v, around);
+            return changed_leaves_[v] = std::move(around);
+          };
+        for (id_type old: old_triangles)
+          for (id_type v: triangle(old).to_vector())
+            {
+              auto & around = changed(v);
+              around.erase(std::find(around.begin(), around.end(), old));
+            }
+        for (size_t k = 0; k < triangles.size(); ++k)
+          for (id_type v: triangles[k].to_vector())
+            changed(v).push_back(first + k);
+      }
+    }
+  }
+}
@@ -0,0 +1,210 @@
+#ifndef _DYNAMIC_REFINEMENT_H
+#define _DYNAMIC_REFINEMENT_H
+
+#include "kirkpatrick_refinement.h"
+
+#include <future>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace geom
+{
+  namespace algorithms
+  {
+    namespace localization
+    {
+      struct dynamic_options
+      {
+        construction_options construction;
+        // a rebuild starts once the overlay holds this fraction of the
+        // triangles of the hierarchy...
+        double rebuild_ratio = 0.05;
+        // ... or a query may walk more overlay levels than this
+        size_t max_overlay_depth = 8;
+        // rebuild on a thread of its own instead of inside the update
+        bool background = true;
+      };
+
+      // Planar subdivision changing a few vertices at a time. Updates
+      // retriangulate the few leaf triangles around the vertex and hang
+      // the new triangles below the old ones, an overlay level under the
+      // static hierarchy. When the overlay grows too large or too deep,
+      // the hierarchy is rebuilt from the current subdivision in the
+      // background and the updates made meanwhile are replayed on it.
+      // Updates the overlay cannot take, like moving a vertex out of its
+      // star, rebuild at once, and wait for a running background rebuild
+      // to finish and discard it. Queries must not run concurrently with
+      // updates.
+      struct dynamic_refinement
+      {
+        typedef kirkpatrick_refinement::id_type id_type;
+
+        // faces as for the subdivision constructor of kirkpatrick_refinement
+        dynamic_refinement(std::vector<point_type> const & points,
+                           std::vector<std::vector<id_type>> const & faces,
+                           dynamic_options const & options = dynamic_options());
+        ~dynamic_refinement();
+
+        dynamic_refinement(dynamic_refinement const &) = delete;
+        dynamic_refinement & operator =(dynamic_refinement const &) = delete;
+
+        // Vertices are addressed by face and position in its ring. An
+        // update changes every face sharing the vertex or edge and
+        // throws std::invalid_argument, leaving the subdivision as it
+        // was, when its result would not be a subdivision.
+
+        // splits edge (face[i], face[i + 1]) by point
+        void insert_vertex(id_type face, size_t i, point_type const & point);
+        // merges the two edges at face[i], which must lie on no other
+        // face than face and the one across those edges
+        void remove_vertex(id_type face, size_t i);
+        void move_vertex(id_type face, size_t i, point_type const & point);
+
+        id_type find_face(point_type const & point) const;
+        void find_faces(point_type const * points, size_t count,
+                        id_type * result) const;
+
+        // face rings index points; indices change when a rebuild drops
+        // the points of removed vertices. The corners of the bounding
+        // triangle follow the points of the hierarchy.
+        std::vector<wide_point_type> const & points() const
+        {
+          return points_;
+        }
+
+        std::vector<std::vector<id_type>> const & faces() const
+        {
+          return faces_;
+        }
+
+        kirkpatrick_refinement const & hierarchy() const
+        {
+          return *base_;
+        }
+
+        size_t overlay_triangles_num() const
+        {
+          return overlay_.size();
+        }
+
+        size_t overlay_depth() const
+        {
+          return overlay_depth_;
+        }
+
+        size_t rebuilds_num() const
+        {
+          return rebuilds_num_;
+        }
+
+        bool is_rebuilding() const
+        {
+          return rebuild_.valid();
+        }
+
+        // blocks until a running background rebuild is swapped in
+        void wait_rebuild();
+
+      private:
+        struct update_type
+        {
+          enum kind_type
+            {
+              INSERT,
+              REMOVE,
+              MOVE
+            };
+
+          kind_type kind;
+          id_type face;
+          size_t index;
+          point_type point;
+        };
+
+        // hierarchy with the leaf triangles around every point
+        struct state_type
+        {
+          std::unique_ptr<kirkpatrick_refinement> base;
+          std::vector<std::vector<id_type>> faces;
+          std::vector<uint32_t> leaf_offsets;
+          std::vector<id_type> leaves;
+        };
+
+        static std::unique_ptr<state_type>
+        build(std::vector<wide_point_type> points,
+              std::vector<std::vector<id_type>> faces,
+              construction_options const & options);
+
+        void reset(std::unique_ptr<state_type> state);
+        // applies update and keeps the rebuild going
+        void perform(update_type const & update);
+        void apply(update_type const & update);
+        // checks the subdivision after an update the overlay cannot take;
+        // loops close the old boundary paths by the new ones, gone is the
+        // vertex removed or moved and q the point added
+        bool is_planar(std::vector<std::vector<id_type>> const & loops,
+                       id_type gone, id_type q) const;
+        void rebuild_now();
+        void check_rebuild();
+        // swaps in a finished background rebuild
+        void poll_rebuild();
+
+        id_type locate(point_type const & point, id_type from) const;
+
+        triangle_type<id_type> const & triangle(id_type id) const
+        {
+          return id < base_triangles_num_
+            ? base_->search_dag().vertices[id]
+            : overlay_[id - base_triangles_num_];
+        }
+
+        id_type face_of(id_type id) const
+        {
+          return id < base_triangles_num_
+            ? base_->face_of(id)
+            : overlay_faces_[id - base_triangles_num_];
+        }
+
+        void leaves(id_type v, std::vector<id_type> & result) const;
+        // link of v in counter clockwise order and the leaf
+        // (v, link[i], link[i + 1])
+        void star(id_type v, std::vector<id_type> & link,
+                  std::vector<id_type> & triangles) const;
+        // replaces leaves by triangles covering the same region
+        void replace(std::vector<id_type> const & old_triangles,
+                     std::vector<triangle_type<id_type>> const & triangles,
+                     std::vector<id_type> const & faces);
+
+      private:
+        dynamic_options options_;
+
+        std::unique_ptr<kirkpatrick_refinement> base_;
+        size_t base_triangles_num_ = 0;
+        std::vector<wide_point_type> points_;
+        std::vector<std::vector<id_type>> faces_;
+        // leaves of the hierarchy around its points; points whose leaves
+        // changed since are looked up in changed_leaves_
+        std::vector<uint32_t> leaf_offsets_;
+        std::vector<id_type> leaves_;
+        std::unordered_map<id_type, std::vector<id_type>> changed_leaves_;
+
+        // triangles added by updates, numbered from base_triangles_num_
+        std::vector<triangle_type<id_type>> overlay_;
+        std::vector<id_type> overlay_faces_;
+        std::vector<uint32_t> overlay_depths_;
+        size_t overlay_depth_ = 0;
+        // replaced leaves and the triangles covering them
+        std::vector<bool> refined_;
+        std::unordered_map<id_type, std::vector<id_type>> children_;
+
+        std::future<std::unique_ptr<state_type>> rebuild_;
+        // updates made since the running rebuild took its snapshot
+        std::vector<update_type> journal_;
+        size_t rebuilds_num_ = 0;
+      };
+    }
+  }
+}
+
+#endif // _DYNAMIC_REFINEMENT_H
@@ -1,6 +1,7 @@
 #ifndef _GRAPH_H
 #define _GRAPH_H
 
+#include <memory>
 #include <vector>
 #include "common.h"
 
@@ -8,18 +9,30 @@ namespace geom
 {
   namespace structures
   {
-    template<typename Vertex>
+    // edge lists take their memory from allocator
+    template<typename Vertex, typename Allocator = std::allocator<id_type>>
     struct graph_type
     {
+      typedef std::vector<id_type, Allocator> edges_type;
+
       std::vector<Vertex> vertices;
-      std::vector<std::vector<id_type>> edges;
+      std::vector<edges_type> edges;
+      Allocator allocator;
 
       void add_edge(id_type from, id_type to)
       {
-        if (edges.size() < std::max(from, to) + 1)
-          edges.resize(std::max(from, to) + 1);
+        while (edges.size() < std::max(from, to) + 1)
+          edges.emplace_back(allocator);
         edges[from].push_back(to);
       }
+
+      // room for count more edges out of from
+      void reserve_edges(id_type from, size_t count)
+      {
+        while (edges.size() < from + 1)
+          edges.emplace_back(allocator);
+        edges[from].reserve(edges[from].size() + count);
+      }
     };
   }
 }
@@ -0,0 +1,171 @@
+#include "half_edge_mesh.h"
+
+#include <algorithm>
+#include <cassert>
+#include <utility>
+
+namespace geom
+{
+  namespace structures
+  {
+    const id_type half_edge_mesh::NONE;
+
+    half_edge_mesh::half_edge_mesh(size_t vertices_num)
+      : out_edge_(vertices_num, NONE)
+      , degree_(vertices_num, 0)
+    {}
+
+    void half_edge_mesh::build(std::vector<triangle_type<id_type>> const & faces,
+                               std::vector<id_type> const & data)
+    {
+      assert(faces.size() == data.size());
+      origin_.reserve(origin_.size() + 3 * faces.size());
+      twin_.reserve(twin_.size() + 3 * faces.size());
+      data_.reserve(data_.size() + faces.size());
+      for (size_t i = 0; i < faces.size(); ++i)
+        add_face(faces[i], data[i]);
+
+      // pair each half-edge u -> v with v -> u
+      std::vector<std::pair<uint64_t, id_type>> keys;
+      keys.reserve(origin_.size());
+      for (id_type e = 0; e < origin_.size(); ++e)
+        keys.emplace_back(uint64_t(origin(e)) << 32 | target(e), e);
+      std::sort(keys.begin(), keys.end());
+      for (auto const & key: keys)
+        {
+          uint64_t reversed = key.first << 32 | key.first >> 32;
+          auto found = std::lower_bound(keys.begin(), keys.end(),
+                                        std::make_pair(reversed, id_type(0)));
+          if (found != keys.end() && found->first == reversed)
+            twin_[key.second] = found->second;
+        }
+    }
+
+    id_type half_edge_mesh::add_face(triangle_type<id_type> const & t, id_type data)
+    {
+      id_type f;
+      if (free_faces_.empty())
+        {
+          f = data_.size();
+          origin_.resize(origin_.size() + 3);
+          twin_.resize(twin_.size() + 3);
+          data_.push_back(data);
+        }
+      else
+        {
+          f = free_faces_.back();
+          free_faces_.pop_back();
+          data_[f] = data;
+        }
+
+      id_type const vertices[] = {t.a, t.b, t.c};
+      for (id_type i = 0; i < 3; ++i)
+        {
+          origin_[3 * f + i] = vertices[i];
+          twin_[3 * f + i] = NONE;
+          out_edge_[vertices[i]] = 3 * f + i;
+          ++degree_[vertices[i]];
+        }
+      return f;
+    }
+
+    size_t half_edge_mesh::star(id_type v, id_type * link,
+                                id_type * data, id_type * border) const
+    {
+      id_type first = out_edge_[v];
+      assert(first != NONE);
+      id_type e = first;
+      size_t i = 0;
+      do
+        {
+          link[i] = target(e);
+          data[i] = data_[face(e)];
+          if (border)
+            border[i] = twin_[next(e)];
+          ++i;
+          e = rotate(e);
+          assert(e != NONE);
+        }
+      while (e != first);
+      assert(i == degree_[v]);
+      return i;
+    }
+
+    void half_edge_mesh::remove_star(id_type v, id_type * link,
+                                     id_type * data, id_type * border)
+    {
+      id_type first = out_edge_[v];
+      size_t size = star(v, link, data, border);
+      for (size_t k = 0; k < size; ++k)
+        {
+          if (border[k] != NONE)
+            twin_[border[k]] = NONE;
+          // the faces (v, link[k - 1], link[k]) and (v, link[k], link[k + 1])
+          degree_[link[k]] -= 2;
+          out_edge_[link[k]] = border[k] == NONE
+            ? NONE
+            : next(border[k]);
+        }
+      id_type e = first;
+      do
+        {
+          id_type following = rotate(e);
+          free_faces_.push_back(face(e));
+          e = following;
+        }
+      while (e != first);
+      out_edge_[v] = NONE;
+      degree_[v] = 0;
+    }
+
+    void half_edge_mesh::fill_hole(id_type const * link, id_type const * border,
+                                   size_t size,
+                                   triangle_type<id_type> const * faces,
+                                   id_type const * data, size_t faces_num)
+    {
+      hole_edges_.clear();
+      for (size_t i = 0; i < faces_num; ++i)
+        {
+          id_type f = add_face(faces[i], data[i]);
+          for (id_type e = 3 * f; e < 3 * f + 3; ++e)
+            {
+              id_type from = origin(e), to = target(e);
+              size_t k = std::find(link, link + size, from) - link;
+              assert(k < size);
+              if (link[k + 1 == size ? 0 : k + 1] == to)
+                {
+                  // side of the hole
+                  if (border[k] != NONE)
+                    link_twins(e, border[k]);
+                  continue;
+                }
+              // diagonal, its twin is in a face added before or after
+              for (id_type other: hole_edges_)
+                if (origin(other) == to && target(other) == from)
+                  link_twins(e, other);
+              hole_edges_.push_back(e);
+            }
+        }
+    }
+
+    size_t half_edge_mesh::link(id_type v, id_type * result) const
+    {
+      id_type first = out_edge_[v];
+      id_type e = first;
+      size_t i = 0;
+      do
+        {
+          result[i++] = target(e);
+          e = rotate(e);
+        }
+      while (e != first);
+      return i;
+    }
+
+    void half_edge_mesh::link_twins(id_type l, id_type r)
+    {
+      twin_[l] = r;
+      twin_[r] = l;
+    }
+  }
+}
@@ -0,0 +1,111 @@
+#ifndef _HALF_EDGE_MESH_H
+#define _HALF_EDGE_MESH_H
+
+#include <vector>
+#include "common.h"
+#include "triangle.h"
+
+namespace geom
+{
+  namespace structures
+  {
+    // Triangle mesh on half-edges with index based, pooled storage.
+    // Face f owns half-edges 3f, 3f + 1, 3f + 2 in counter clockwise
+    // order, so next and prev are arithmetic; removed faces go to a free
+    // list and are reused by later add_face calls.
+    struct half_edge_mesh
+    {
+      static const id_type NONE = id_type(-1);
+
+      explicit half_edge_mesh(size_t vertices_num);
+
+      // faces are counter clockwise, data[i] is attached to faces[i]
+      void build(std::vector<triangle_type<id_type>> const & faces,
+                 std::vector<id_type> const & data);
+
+      id_type add_face(triangle_type<id_type> const & t, id_type data);
+
+      // Star of vertex v, which must not lie on the mesh border. link
+      // receives the neighbours of v in counter clockwise order, data[i]
+      // the value of face (v, link[i], link[i + 1]) and border[i] the twin
+      // of half-edge link[i] -> link[i + 1]. Buffers must hold degree(v)
+      // entries, border may be null.
+      size_t star(id_type v, id_type * link,
+                  id_type * data, id_type * border) const;
+
+      // removes all faces around v, the buffers are filled as by star
+      void remove_star(id_type v, id_type * link,
+                       id_type * data, id_type * border);
+
+      // Covers the hole left by remove_star with faces over link vertices.
+      void fill_hole(id_type const * link, id_type const * border, size_t size,
+                     triangle_type<id_type> const * faces, id_type const * data,
+                     size_t faces_num);
+
+      // neighbours of an interior vertex in counter clockwise order
+      size_t link(id_type v, id_type * result) const;
+
+      size_t degree(id_type v) const
+      {
+        return degree_[v];
+      }
+
+      id_type origin(id_type edge) const
+      {
+        return origin_[edge];
+      }
+
+      id_type target(id_type edge) const
+      {
+        return origin_[next(edge)];
+      }
+
+      id_type twin(id_type edge) const
+      {
+        return twin_[edge];
+      }
+
+      id_type data(id_type face) const
+      {
+        return data_[face];
+      }
+
+      // next outgoing half-edge of origin(edge) in counter clockwise order
+      id_type rotate(id_type edge) const
+      {
+        return twin_[prev(edge)];
+      }
+
+      static id_type face(id_type edge)
+      {
+        return edge / 3;
+      }
+
+      static id_type next(id_type edge)
+      {
+        return edge % 3 == 2 ? edge - 2 : edge + 1;
+      }
+
+      static id_type prev(id_type edge)
+      {
+        return edge % 3 == 0 ? edge + 2 : edge - 1;
+      }
+
+    private:
+      void link_twins(id_type l, id_type r);
+
+    private:
+      std::vector<id_type> origin_;
+      std::vector<id_type> twin_;
+      std::vector<id_type> data_;
+      std::vector<id_type> free_faces_;
+      // some outgoing half-edge per vertex
+      std::vector<id_type> out_edge_;
+      std::vector<uint32_t> degree_;
+      // half-edges of the faces added by the current fill_hole
+      std::vector<id_type> hole_edges_;
+    };
+  }
+}
+
+#endif // _HALF_EDGE_MESH_H
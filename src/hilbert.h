@@ -0,0 +1,36 @@
+#ifndef _HILBERT_H
+#define _HILBERT_H
+
+#include <cstdint>
+
+namespace geom
+{
+  namespace algorithms
+  {
+    // Position of (x, y) along the Hilbert curve through the
+    // 2^order x 2^order grid, order at most 32. Points close on the
+    // curve are close in the plane.
+    inline uint64_t hilbert_index(uint32_t x, uint32_t y, unsigned order = 32)
+    {
+      uint64_t result = 0;
+      for (uint32_t s = uint32_t(1) << (order - 1); s != 0; s >>= 1)
+        {
+          uint32_t rx = (x & s) != 0;
+          uint32_t ry = (y & s) != 0;
+          result += uint64_t(s) * s * ((3 * rx) ^ ry);
+          // turn the quadrant so the curve enters at its corner: mirror
+          // when rx and not ry, swap x and y when not ry; without
+          // branches, the bits are random
+          uint32_t mirror = 0 - (rx & (ry ^ 1));
+          x ^= mirror;
+          y ^= mirror;
+          uint32_t swap = (x ^ y) & (0 - (ry ^ 1));
+          x ^= swap;
+          y ^= swap;
+        }
+      return result;
+    }
+  }
+}
+
+#endif // _HILBERT_H
@@ -0,0 +1,50 @@
+# The point location core, free of Qt. Needs the geometry primitives
+# from visualization/headers, which are header only.
+
+INCLUDEPATH += $$PWD
+
+# debug builds check the dag links against triangle intersection
+CONFIG(debug, debug|release): DEFINES += KIRKPATRICK_CHECK_LINKS
+
+HEADERS += $$PWD/determinant.h \
+           $$PWD/predicates.h \
+           $$PWD/circular.h \
+           $$PWD/graph.h \
+           $$PWD/arena.h \
+           $$PWD/half_edge_mesh.h \
+           $$PWD/common.h \
+           $$PWD/triangle.h \
+           $$PWD/wide_point.h \
+           $$PWD/kirkpatrick_refinement.h \
+           $$PWD/turn.h \
+           $$PWD/turn_kernels.h \
+           $$PWD/query_layout.h \
+           $$PWD/thread_pool.h \
+           $$PWD/hilbert.h \
+           $$PWD/polygon_triangulation.h \
+           $$PWD/serialization.h \
+           $$PWD/point_io.h \
+           $$PWD/query_stats.h \
+           $$PWD/dag_statistics.h \
+           $$PWD/dynamic_refinement.h \
+           $$PWD/snapshot_publisher.h \
+           $$PWD/static_dag.h \
+           $$PWD/refinement_collection.h \
+           $$PWD/query_executor.h \
+
+SOURCES += $$PWD/kirkpatrick_refinement.cpp \
+           $$PWD/triangle.cpp \
+           $$PWD/half_edge_mesh.cpp \
+           $$PWD/turn.cpp \
+           $$PWD/predicates.cpp \
+           $$PWD/turn_kernels.cpp \
+           $$PWD/query_layout.cpp \
+           $$PWD/thread_pool.cpp \
+           $$PWD/polygon_triangulation.cpp \
+           $$PWD/serialization.cpp \
+           $$PWD/point_io.cpp \
+           $$PWD/query_stats.cpp \
+           $$PWD/dag_statistics.cpp \
+           $$PWD/dynamic_refinement.cpp \
+           $$PWD/refinement_collection.cpp \
+           $$PWD/query_executor.cpp \
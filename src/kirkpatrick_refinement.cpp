@@ -1,9 +1,18 @@
 #include "kirkpatrick_refinement.h"
 #include "turn.h"
 #include "circular.h"
+#include "thread_pool.h"
+#include "polygon_triangulation.h"
+#include "hilbert.h"
+#include "predicates.h"
 
 #include <algorithm>
+#include <cmath>
 #include <cassert>
+#include <limits>
+#include <memory>
+#include <numeric>
+#include <stdexcept>
 
 namespace geom
 {
@@ -11,44 +20,124 @@ namespace geom
   {
     namespace localization
     {
-      kirkpatrick_refinement::kirkpatrick_refinement(std::vector<point_type> const & poly)
-        : points_(poly.begin(), poly.end())
+      const kirkpatrick_refinement::id_type kirkpatrick_refinement::NO_FACE;
+
+      namespace
+      {
+        // Twice the area of the intersection of two counter clockwise
+        // triangles, clipping one by the edges of the other. Vertices cut
+        // by an edge are truncated to integers and the rest is exact, so
+        // the order of children it gives is the same on every platform;
+        // corners within +-2^34 keep every product within 128 bits.
+        geom::predicates::int128_t overlap_area(triangle_type<wide_point_type> const & l,
+                                                triangle_type<wide_point_type> const & r)
+        {
+          typedef geom::predicates::int128_t int128_t;
+          // a triangle clipped by three half planes keeps at most 6 vertices
+          wide_point_type points[2][9] = {{l.a, l.b, l.c}};
+          size_t size = 3;
+          wide_point_type const * corners[] = {&r.a, &r.b, &r.c};
+          for (size_t e = 0; e < 3 && size > 0; ++e)
+            {
+              wide_point_type const & a = *corners[e];
+              int64_t dx = corners[(e + 1) % 3]->x - a.x, dy = corners[(e + 1) % 3]->y - a.y;
+              wide_point_type const * p = points[e % 2];
+              wide_point_type * q = points[(e + 1) % 2];
+              size_t clipped = 0;
+              for (size_t i = 0; i < size; ++i)
+                {
+                  size_t j = (i + 1) % size;
+                  int128_t si = int128_t(dx) * (p[i].y - a.y) - int128_t(dy) * (p[i].x - a.x);
+                  int128_t sj = int128_t(dx) * (p[j].y - a.y) - int128_t(dy) * (p[j].x - a.x);
+                  if (si >= 0)
+                    q[clipped++] = p[i];
+                  if ((si < 0) != (sj < 0) && si != sj)
+                    q[clipped++] = wide_point_type(
+                      p[i].x + int64_t(si * (p[j].x - p[i].x) / (si - sj)),
+                      p[i].y + int64_t(si * (p[j].y - p[i].y) / (si - sj)));
+                }
+              size = clipped;
+            }
+          wide_point_type const * p = points[1];
+          int128_t result = 0;
+          for (size_t i = 0; i < size; ++i)
+            {
+              size_t j = (i + 1) % size;
+              result += int128_t(p[i].x) * p[j].y - int128_t(p[j].x) * p[i].y;
+            }
+          return result;
+        }
+
+        // Cells [lo, hi] of the row at y of raster in the counter
+        // clockwise triangle a, b, c, lo > hi when there are none. The
+        // cell x = x0 + k step_x is left of edge (a, b) while
+        // dy step_x k <= dx (y - ay) - dy (x0 - ax), so edges going up
+        // bound the cells from the right and edges going down from the
+        // left.
+        void row_span(wide_point_type const & a, wide_point_type const & b,
+                      wide_point_type const & c,
+                      raster_type const & raster, int64_t y, int64_t & lo, int64_t & hi)
+        {
+          typedef geom::predicates::int128_t int128_t;
+          wide_point_type const * corners[] = {&a, &b, &c};
+          lo = 0;
+          hi = int64_t(raster.width) - 1;
+          for (size_t e = 0; e < 3; ++e)
+            {
+              wide_point_type const & p = *corners[e];
+              wide_point_type const & q = *corners[(e + 1) % 3];
+              int64_t dx = q.x - p.x, dy = q.y - p.y;
+              int128_t r = int128_t(dx) * (y - p.y)
+                - int128_t(dy) * (int64_t(raster.origin.x) - p.x);
+              int128_t k = int128_t(dy < 0 ? -dy : dy) * raster.step_x;
+              if (dy == 0)
+                {
+                  if (r < 0)
+                    hi = -1;
+                }
+              else if (dy > 0)
+                {
+                  int128_t bound = r / k;
+                  if (r % k != 0 && r < 0)
+                    --bound;
+                  if (bound < hi)
+                    hi = int64_t(std::max<int128_t>(bound, -1));
+                }
+              else
+                {
+                  int128_t bound = -r / k;
+                  if (-r % k != 0 && -r > 0)
+                    ++bound;
+                  if (bound > lo)
+                    lo = int64_t(std::min<int128_t>(bound, raster.width));
+                }
+            }
+        }
+      }
+
+      kirkpatrick_refinement::kirkpatrick_refinement(std::vector<point_type> const & poly,
+                                                     construction_options const & options)
+        : kirkpatrick_refinement(std::vector<point_type>(poly), options)
+      {}
+
+      kirkpatrick_refinement::kirkpatrick_refinement(std::vector<point_type> && poly,
+                                                     construction_options const & options)
+        : options_(options)
+        , points_(std::move(poly))
       {
         // poly should be oriented counter clock wise
-        assert(poly.size() > 2);
-        const id_type n = poly.size();
-        // DCEL would be a better alternative
-        std::vector<set_type> triangles(n + 3);
+        assert(points_.size() > 2);
+        check_options();
+        const id_type n = points_.size();
+        reserve(n);
 
         // rotate to leftmost
         auto leftmost = std::min_element(points_.begin(), points_.end());
         std::rotate(points_.begin(), leftmost, points_.end());
-
-        // bounds
-        auto rightmost = std::max_element(points_.begin(), points_.end());
-        auto rightmost_id = rightmost - points_.begin();
-        auto minmax_y = std::minmax_element(points_.begin(), points_.end(),
-                                            [](point_type const & l,
-                                               point_type const & r)
-                                            {
-                                              if (l.y == r.y)
-                                                return l.x < r.x;
-                                              return l.y < r.y;
-                                            });
-        auto downmost = *std::get<0>(minmax_y);
-        auto upmost = *std::get<1>(minmax_y);
-        point_type leftdown(points_[0].x, downmost.y);
-        int margin = 73;
-        // top triangle
-        points_.emplace_back(leftdown.x - margin, leftdown.y - margin);
-        points_.emplace_back((rightmost->x << 1) - leftdown.x + margin,
-                             leftdown.y - margin);
-        points_.emplace_back(leftdown.x - margin,
-                             (upmost.y << 1) - leftdown.y + margin);
-        add_triangle({n, n + 1, n + 2}, triangles);
-
-        for (id_type i = 0; i < n; i++)
-          assert(triangle_by_id(0).contains(points_[i]));
+        auto rightmost_id = std::max_element(points_.begin(), points_.end())
+          - points_.begin();
+        add_bounding_triangle();
+        const std::vector<wide_point_type> vertices = this->vertices();
 
         // initial triangulation
         std::vector<id_type> lower_part = {n, n + 1}, upper_part;
@@ -63,94 +152,385 @@ namespace geom
           upper_part.push_back(i);
         upper_part.insert(upper_part.end(), {n + 1, n + 2, 0});
 
-        for (auto triangle: triangulate(initial))
-          add_triangle(triangle, triangles);
+        std::vector<triangle_type<id_type>> part_triangles;
+        monotonic_arena scratch;
+        // where ear clipping starts, from the seed so builds repeat
+        std::mt19937 random(options_.seed);
+        auto add_triangulation = [&](std::vector<id_type> const & part)
+        {
+          part_triangles.clear();
+          // ear clipping is kept for polygons too degenerate for the sweep
+          if (!triangulation::triangulate_polygon(vertices, part, part_triangles))
+            {
+              triangulate(part, random(), scratch, part_triangles);
+              scratch.release();
+            }
+          for (auto const & triangle: part_triangles)
+            add_triangle(triangle);
+        };
 
-        add_triangle({n + 2, n, 0}, triangles);
-        for (auto triangle: triangulate(lower_part))
-          add_triangle(triangle, triangles);
+        add_triangulation(initial);
+        add_triangle({n + 2, n, 0});
+        add_triangulation(lower_part);
+        add_triangulation(upper_part);
 
-        for (auto triangle: triangulate(upper_part))
-          add_triangle(triangle, triangles);
+        simple_triangles_num_ = n - 2;
+        face_of_.assign(triangles_num(), NO_FACE);
+        std::fill(face_of_.begin() + 1, face_of_.begin() + 1 + simple_triangles_num_, 0);
+        build_hierarchy(vertices);
+      }
+
+      kirkpatrick_refinement::kirkpatrick_refinement(std::vector<point_type> const & points,
+                                                     std::vector<std::vector<id_type>> const & faces,
+                                                     construction_options const & options)
+        : kirkpatrick_refinement(std::vector<point_type>(points), faces, options)
+      {}
+
+      kirkpatrick_refinement::kirkpatrick_refinement(std::vector<point_type> && points,
+                                                     std::vector<std::vector<id_type>> const & faces,
+                                                     construction_options const & options)
+        : options_(options)
+        , points_(std::move(points))
+      {
+        check_options();
+        const id_type n = points_.size();
+        if (n < 3 || faces.empty())
+          throw std::invalid_argument("kirkpatrick_refinement: empty subdivision");
+        reserve(n);
+        add_bounding_triangle();
+        const std::vector<wide_point_type> vertices = this->vertices();
+        check_faces(faces, vertices);
+        face_of_.push_back(NO_FACE);
+
+        // faces are triangulated on their own, so no triangle crosses an edge
+        std::vector<triangle_type<id_type>> part_triangles;
+        monotonic_arena scratch;
+        for (id_type f = 0; f < faces.size(); ++f)
+          {
+            auto const & face = faces[f];
+            if (polygon_area(face) <= 0)
+              throw std::invalid_argument("kirkpatrick_refinement: face is not "
+                                          "a counter clockwise polygon");
+            part_triangles.clear();
+            if (!triangulation::triangulate_polygon(vertices, face, part_triangles))
+              {
+                triangulate(face, 0, scratch, part_triangles);
+                scratch.release();
+              }
+            for (auto const & triangle: part_triangles)
+              {
+                add_triangle(triangle);
+                face_of_.push_back(f);
+              }
+          }
+        simple_triangles_num_ = triangles_num() - 1;
+
+        // the rest of the bounding triangle, bounded by the face edges
+        // that are not shared by two faces
+        std::vector<std::vector<id_type>> rings(1, std::vector<id_type>{n, n + 1, n + 2});
+        boundary_rings(faces, rings);
+        part_triangles.clear();
+        if (!triangulation::triangulate_region(vertices, rings, part_triangles))
+          throw std::invalid_argument("kirkpatrick_refinement: faces overlap or "
+                                      "their boundary is degenerate");
+        for (auto const & triangle: part_triangles)
+          add_triangle(triangle);
+        face_of_.resize(triangles_num(), NO_FACE);
+
+        build_hierarchy(vertices);
+      }
+
+      void kirkpatrick_refinement::reserve(size_t n)
+      {
+        // 2 n + 2 triangles in the initial triangulation, about 5 n in
+        // all for every degree threshold
+        const size_t triangles = 6 * n + 8;
+        search_dag_.vertices.reserve(triangles);
+        search_dag_.edges.reserve(triangles);
+        face_of_.reserve(2 * n + 2);
+      }
+
+      void kirkpatrick_refinement::check_options() const
+      {
+        const size_t DEGREE_THRESHOLD = options_.degree_threshold;
+        if (DEGREE_THRESHOLD < 7 || DEGREE_THRESHOLD > triangulation::MAX_STAR_SIZE + 1)
+          throw std::invalid_argument("kirkpatrick_refinement: degree threshold "
+                                      "out of [7, MAX_STAR_SIZE + 1]");
+      }
+
+      void kirkpatrick_refinement::add_bounding_triangle()
+      {
+        const id_type n = points_.size();
+        int64_t min_x = points_[0].x, max_x = min_x;
+        int64_t min_y = points_[0].y, max_y = min_y;
+        for (point_type const & p: points_)
+          {
+            min_x = std::min<int64_t>(min_x, p.x);
+            max_x = std::max<int64_t>(max_x, p.x);
+            min_y = std::min<int64_t>(min_y, p.y);
+            max_y = std::max<int64_t>(max_y, p.y);
+          }
+        const int64_t margin = 73;
+        // top triangle, its long side passes (max_x + margin, max_y +
+        // margin), strictly beyond the bounding box; within +-2^34 for
+        // any int32 points
+        corners_[0] = wide_point_type(min_x - margin, min_y - margin);
+        corners_[1] = wide_point_type(2 * max_x - min_x + 3 * margin, min_y - margin);
+        corners_[2] = wide_point_type(min_x - margin, 2 * max_y - min_y + 3 * margin);
+        add_triangle({n, n + 1, n + 2});
+
+        for (id_type i = 0; i < n; i++)
+          assert(triangle_by_id(0).contains(points_[i]));
+      }
+
+      std::vector<wide_point_type> kirkpatrick_refinement::vertices() const
+      {
+        std::vector<wide_point_type> result;
+        result.reserve(points_.size() + 3);
+        result.assign(points_.begin(), points_.end());
+        result.insert(result.end(), corners_, corners_ + 3);
+        return result;
+      }
+
+      double kirkpatrick_refinement::polygon_area(std::vector<id_type> const & poly) const
+      {
+        double result = 0;
+        for (size_t i = 0, j = poly.size() - 1; i < poly.size(); j = i++)
+          result += double(points_[poly[j]].x) * points_[poly[i]].y
+            - double(points_[poly[i]].x) * points_[poly[j]].y;
+        return result / 2;
+      }
+
+      void kirkpatrick_refinement::check_faces(std::vector<std::vector<id_type>> const & faces,
+                                               std::vector<wide_point_type> const & vertices) const
+      {
+        const id_type n = points_.size();
+        // face of the last visit to every point, to catch repeats
+        std::vector<id_type> seen(n, NO_FACE);
+        std::vector<id_type> used;
+        std::vector<std::pair<id_type, id_type>> edges;
+        for (id_type f = 0; f < faces.size(); ++f)
+          {
+            auto const & face = faces[f];
+            if (face.size() < 3)
+              throw std::invalid_argument("kirkpatrick_refinement: face is not "
+                                          "a counter clockwise polygon");
+            for (size_t i = 0; i < face.size(); ++i)
+              {
+                id_type v = face[i];
+                if (v >= n)
+                  throw std::invalid_argument("kirkpatrick_refinement: face vertex out of range");
+                if (seen[v] == f)
+                  throw std::invalid_argument("kirkpatrick_refinement: face repeats a vertex");
+                if (seen[v] == NO_FACE)
+                  used.push_back(v);
+                seen[v] = f;
+                edges.emplace_back(v, face[i + 1 == face.size() ? 0 : i + 1]);
+              }
+          }
+
+        std::sort(used.begin(), used.end(), [&](id_type l, id_type r)
+                  {
+                    return vertices[l] < vertices[r];
+                  });
+        for (size_t i = 1; i < used.size(); ++i)
+          if (vertices[used[i - 1]] == vertices[used[i]])
+            throw std::invalid_argument("kirkpatrick_refinement: faces have "
+                                        "coincident vertices");
+        if (!triangulation::edges_meet_at_ends(vertices, std::move(edges)))
+          throw std::invalid_argument("kirkpatrick_refinement: face edges cross");
+      }
+
+      void kirkpatrick_refinement::boundary_rings(std::vector<std::vector<id_type>> const & faces,
+                                                  std::vector<std::vector<id_type>> & rings) const
+      {
+        // directed face edges; an edge used twice in one direction means
+        // overlapping faces
+        std::vector<std::pair<id_type, id_type>> edges;
+        for (auto const & face: faces)
+          for (size_t i = 0; i < face.size(); ++i)
+            edges.emplace_back(face[i], face[i + 1 == face.size() ? 0 : i + 1]);
+        std::sort(edges.begin(), edges.end());
+        if (std::adjacent_find(edges.begin(), edges.end()) != edges.end())
+          throw std::invalid_argument("kirkpatrick_refinement: faces overlap");
+
+        // unshared edges reversed, so the uncovered region lies on their left
+        std::vector<std::pair<id_type, id_type>> border;
+        for (auto const & e: edges)
+          if (!std::binary_search(edges.begin(), edges.end(), std::make_pair(e.second, e.first)))
+            border.emplace_back(e.second, e.first);
+        std::sort(border.begin(), border.end());
+
+        auto outgoing = [&](id_type v)
+          {
+            return std::equal_range(border.begin(), border.end(), std::make_pair(v, id_type(0)),
+                                    [](std::pair<id_type, id_type> const & l,
+                                       std::pair<id_type, id_type> const & r)
+                                    {
+                                      return l.first < r.first;
+                                    });
+          };
+        // Where the border passes a vertex twice, it goes on with the
+        // first edge clockwise from the one it came along, so the rings
+        // touch there without crossing.
+        auto follow = [&](size_t k)
+          {
+            const double PI = 3.14159265358979323846;
+            point_type const & o = points_[border[k].second];
+            point_type const & from = points_[border[k].first];
+            double back = std::atan2(double(from.y) - o.y, double(from.x) - o.x);
+            auto range = outgoing(border[k].second);
+            size_t result = border.size();
+            double best = 0;
+            for (auto it = range.first; it != range.second; ++it)
+              {
+                point_type const & t = points_[it->second];
+                double clockwise = back - std::atan2(double(t.y) - o.y, double(t.x) - o.x);
+                if (clockwise <= 0)
+                  clockwise += 2 * PI;
+                if (result == border.size() || clockwise < best)
+                  {
+                    result = it - border.begin();
+                    best = clockwise;
+                  }
+              }
+            return result;
+          };
+
+        std::vector<bool> used(border.size(), false);
+        for (size_t start = 0; start < border.size(); ++start)
+          {
+            if (used[start])
+              continue;
+            rings.emplace_back();
+            size_t k = start;
+            do
+              {
+                if (k == border.size() || used[k])
+                  throw std::invalid_argument("kirkpatrick_refinement: face boundary "
+                                              "is not closed");
+                used[k] = true;
+                rings.back().push_back(border[k].first);
+                k = follow(k);
+              }
+            while (k != start);
+          }
+      }
+
+      void kirkpatrick_refinement::build_hierarchy(std::vector<wide_point_type> const & vertices)
+      {
+        const id_type n = points_.size();
+        const size_t DEGREE_THRESHOLD = options_.degree_threshold;
+        level_ends_.push_back(triangles_num());
+
+        // edge lists are only added, so they are carved from one arena
+        search_dag_.arena = std::make_shared<monotonic_arena>();
+        search_dag_.allocator = search_dag_.arena.get();
+
+        // the root is not part of the mesh
+        half_edge_mesh mesh(n + 3);
+        std::vector<id_type> ids(triangles_num() - 1);
+        std::iota(ids.begin(), ids.end(), 1);
+        mesh.build(std::vector<triangle_type<id_type>>(search_dag_.vertices.begin() + 1,
+                                                       search_dag_.vertices.end()),
+                   ids);
+        // face f of the mesh is leaf f + 1, half-edge 3 f + k its edge k
+        leaf_neighbours_.assign(3 * triangles_num(), 0);
+        for (id_type e = 0; e < 3 * ids.size(); ++e)
+          if (mesh.twin(e) != half_edge_mesh::NONE)
+            leaf_neighbours_[3 + e] = mesh.data(half_edge_mesh::face(mesh.twin(e)));
 
         // low degree vertices
-        std::deque<id_type> low_degree;
+        std::vector<id_type> low_degree;
         for (id_type i = 0; i < n; ++i)
-          if (triangles[i].size() < DEGREE_THRESHOLD)
+          if (mesh.degree(i) < DEGREE_THRESHOLD)
             low_degree.push_back(i);
 
+        // scratch buffers, reused for every removed vertex
+        std::vector<id_type> points(DEGREE_THRESHOLD);
+        std::vector<id_type> adjacent_triangles(DEGREE_THRESHOLD);
+        std::vector<id_type> border(DEGREE_THRESHOLD);
+        std::vector<size_t> neighbours_degrees(DEGREE_THRESHOLD);
+        std::vector<id_type> new_triangles;
+        new_triangles.reserve(DEGREE_THRESHOLD);
+        std::vector<removal_type> removals;
+        std::vector<bool> marks(n + 3, false);
+        thread_pool pool(std::max<size_t>(options_.threads, 1));
+        std::vector<plan_type> plans(pool.size());
+        std::mt19937 random(options_.seed);
+
         // main loop
         while (true)
           {
-            auto iset = find_independent_set(low_degree, triangles);
+            auto iset = find_independent_set(low_degree, mesh, random, marks);
             if (iset.empty())
               break;
-            for (id_type j: iset)
-              {
-                assert(j < n);
-                auto & jth = triangles[j];
-                std::vector<id_type> adjacent_triangles(jth.begin(), jth.end());
-                assert(adjacent_triangles.size() >= 3);
-                // remove neighbour triangles and construct poly
-                jth.clear();
-                std::vector<id_type> points(adjacent_triangles.size());
-                std::transform(adjacent_triangles.begin(), adjacent_triangles.end(),
-                               points.begin(), [&](id_type t)
-                {
-                  return next_point(j, t);
-                });
-                // sort triangles
-                std::sort(points.begin(), points.end(), [&](id_type l, id_type r)
-                          {
-                            auto a = points_[l] - points_[j];
-                            auto b = points_[r] - points_[j];
 
-                            if (a.x >= 0 && b.x < 0)
-                              return true;
-                            if (a.x < 0 && b.x >= 0)
-                              return false;
+            // stars of an independent set are disjoint, so they are
+            // retriangulated in parallel against the mesh of this level
+            if (removals.size() < iset.size())
+              removals.resize(iset.size());
+            for (plan_type & plan: plans)
+              {
+                plan.triangles.clear();
+                plan.overlaps.clear();
+              }
+            pool.parallel_for(iset.size(), 64,
+                              [&](size_t begin, size_t end, size_t worker)
+                              {
+                                for (size_t i = begin; i < end; ++i)
+                                  {
+                                    removals[i].worker = worker;
+                                    plan_removal(iset[i], vertices, mesh,
+                                                 plans[worker], removals[i]);
+                                  }
+                              });
 
-                            return (a ^ b) > 0;
-                          });
+            // applied in independent set order, so ids do not depend
+            // on the number of threads
+            for (size_t r = 0; r < iset.size(); ++r)
+              {
+                id_type j = iset[r];
+                removal_type const & removal = removals[r];
+                plan_type const & plan = plans[removal.worker];
+                auto const * triangles = plan.triangles.data() + removal.triangles_begin;
+                const size_t triangles_num = removal.triangles_end - removal.triangles_begin;
+                assert(j < n);
+                const size_t degree = mesh.degree(j);
+                assert(degree >= 3 && degree < DEGREE_THRESHOLD);
                 // memorize degrees
-                std::vector<size_t> neighbours_degrees(points.size());
-                std::transform(points.begin(), points.end(),
-                               neighbours_degrees.begin(),
-                               [&](id_type id) {return triangles[id].size();});
-                // remove neighbour triangles
-                for (id_type t: adjacent_triangles)
-                  {
-                    id_type p = next_point(j, t);
-                    for (auto neighbour: {p, next_point(p, t)})
-                      {
-                        auto found = triangles[neighbour].find(t);
-                        assert(found != triangles[neighbour].end());
-                        triangles[neighbour].erase(found);
-                      }
-                  }
+                mesh.link(j, points.data());
+                for (size_t i = 0; i < degree; ++i)
+                  neighbours_degrees[i] = mesh.degree(points[i]);
+                mesh.remove_star(j, points.data(), adjacent_triangles.data(),
+                                 border.data());
 
-                // re triangulate
-                auto triangulation = triangulate(points);
-                for (auto triangle: triangulation)
+                new_triangles.clear();
+                for (size_t t = 0; t < triangles_num; ++t)
+                  new_triangles.push_back((triangles[t] == search_dag_.vertices[0])
+                                          ? 0
+                                          : add_triangle(triangles[t]));
+                // update search dag, overlaps come grouped by new triangle
+                auto const & overlaps = plan.overlaps;
+                for (size_t k = removal.overlaps_begin, end = k;
+                     k < removal.overlaps_end; k = end)
                   {
-                    size_t size = (triangle == search_dag_.vertices[0])
-                      ? 0
-                      : add_triangle(triangle, triangles);
-                    // update search dag
-                    for (auto i: adjacent_triangles)
-                      {
-                        auto old_triangle = triangle_by_id(i);
-                        auto new_triangle = triangle_by_id(size);
-                        if (old_triangle.intersects(new_triangle))
-                          search_dag_.add_edge(size, i);
-                      }
+                    while (end < removal.overlaps_end
+                           && overlaps[end].first == overlaps[k].first)
+                      ++end;
+                    id_type from = new_triangles[overlaps[k].first];
+                    search_dag_.reserve_edges(from, end - k);
+                    for (size_t e = k; e < end; ++e)
+                      search_dag_.add_edge(from, overlaps[e].second);
                   }
+                mesh.fill_hole(points.data(), border.data(), degree,
+                               triangles, new_triangles.data(), triangles_num);
 
                 // add new low degree points
-                for (size_t i = 0; i < points.size(); ++i)
-                  if (neighbours_degrees[i] >= DEGREE_THRESHOLD &&      // before
-                      triangles[points[i]].size() < DEGREE_THRESHOLD && // after
-                      points[i] < n)                                    // not root
+                for (size_t i = 0; i < degree; ++i)
+                  if (neighbours_degrees[i] >= DEGREE_THRESHOLD &&     // before
+                      mesh.degree(points[i]) < DEGREE_THRESHOLD &&     // after
+                      points[i] < n)                                   // not root
                     low_degree.push_back(points[i]);
               }
 
@@ -159,50 +539,551 @@ namespace geom
                                      low_degree.end(),
                                      [&](id_type id)
                                      {
-                                       return triangles[id].size() >= DEGREE_THRESHOLD;
+                                       return mesh.degree(id) >= DEGREE_THRESHOLD;
                                      });
             if (it != low_degree.end())
               low_degree.erase(it, low_degree.end());
+            level_ends_.push_back(triangles_num());
+          }
+
+        // children in the order of the share of their parent they cover,
+        // the chance a query in the parent is in them
+        std::vector<std::pair<geom::predicates::int128_t, id_type>> weighted;
+        for (id_type id = level_ends_[0]; id < triangles_num(); ++id)
+          {
+            auto & children = search_dag_.edges[id];
+            triangle_type<wide_point_type> parent = triangle_by_id(id);
+            weighted.clear();
+            for (id_type child: children)
+              weighted.emplace_back(-overlap_area(triangle_by_id(child), parent), child);
+            // ids break ties, so the order does not depend on the sort
+            std::sort(weighted.begin(), weighted.end());
+            for (size_t i = 0; i < children.size(); ++i)
+              children[i] = weighted[i].second;
           }
+
+        layout_ = query_layout(vertices, search_dag_);
+        build_classes(n);
       }
 
-      kirkpatrick_refinement::id_type
-      kirkpatrick_refinement::find_query(point_type const & point) const
+      void kirkpatrick_refinement::build_classes(id_type n)
+      {
+        min_corner_ = max_corner_ = points_[0];
+        for (id_type i = 1; i < n; ++i)
+          {
+            min_corner_.x = std::min(min_corner_.x, points_[i].x);
+            min_corner_.y = std::min(min_corner_.y, points_[i].y);
+            max_corner_.x = std::max(max_corner_.x, points_[i].x);
+            max_corner_.y = std::max(max_corner_.y, points_[i].y);
+          }
+
+        // monotone chain, collinear points dropped
+        std::vector<point_type> sorted(points_.begin(), points_.begin() + n);
+        std::sort(sorted.begin(), sorted.end());
+        sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+        hull_.assign(2 * sorted.size(), point_type());
+        size_t k = 0;
+        for (size_t i = 0; i < sorted.size(); ++i)
+          {
+            while (k >= 2 && turn(hull_[k - 2], hull_[k - 1], sorted[i]) <= 0)
+              --k;
+            hull_[k++] = sorted[i];
+          }
+        for (size_t i = sorted.size() - 1, lower = k + 1; i-- > 0; )
+          {
+            while (k >= lower && turn(hull_[k - 2], hull_[k - 1], sorted[i]) <= 0)
+              --k;
+            hull_[k++] = sorted[i];
+          }
+        hull_.resize(k > 1 ? k - 1 : k);
+        hull_.shrink_to_fit();
+
+        // children before parents: they are older, the root comes last
+        node_classes_.assign(layout_.nodes_num(), MIXED);
+        auto classify_node = [&](id_type id)
+          {
+            id_type node = layout_.node_of(id);
+            // triangles the root does not reach
+            if (node >= node_classes_.size())
+              return;
+            if (layout_.is_leaf(node))
+              {
+                node_classes_[node] = face_of(id) == NO_FACE ? OUTSIDE : INSIDE;
+                return;
+              }
+            uint8_t result = 0;
+            bool first = true;
+            layout_.for_each_child(node, [&](id_type child)
+                                   {
+                                     result = first || node_classes_[child] == result
+                                       ? node_classes_[child] : uint8_t(MIXED);
+                                     first = false;
+                                   });
+            node_classes_[node] = result;
+          };
+        for (id_type id = 1; id < triangles_num(); ++id)
+          classify_node(id);
+        classify_node(0);
+      }
+
+      bool kirkpatrick_refinement::in_hull(point_type const & point) const
       {
-        id_type id = 0;
-        id_type old_id = 1;
-        while (id != old_id)
+        const size_t h = hull_.size();
+        if (h < 3)
+          return true;
+        if (turn(hull_[0], hull_[1], point) < 0 || turn(hull_[0], hull_[h - 1], point) > 0)
+          return false;
+        size_t lo = 1, hi = h - 1;
+        while (hi - lo > 1)
           {
-            old_id = id;
-            id = find_step(point, id);
+            size_t mid = (lo + hi) / 2;
+            if (turn(hull_[0], hull_[mid], point) >= 0)
+              lo = mid;
+            else
+              hi = mid;
           }
+        return turn(hull_[lo], hull_[hi], point) >= 0;
+      }
+
+      bool kirkpatrick_refinement::classify(point_type const & point) const
+      {
+        if (point.x < min_corner_.x || point.x > max_corner_.x
+            || point.y < min_corner_.y || point.y > max_corner_.y
+            || !in_hull(point))
+          return false;
+        return node_classes_[layout_.descend(point, node_classes_.data())] == INSIDE;
+      }
 
-        return id;
+      void kirkpatrick_refinement::classify(point_type const * points, size_t count,
+                                            bool * result) const
+      {
+        // the points left after the rejects descend together
+        const size_t CHUNK = 1024;
+        point_type left[CHUNK];
+        size_t positions[CHUNK];
+        id_type nodes[CHUNK];
+        for (size_t first = 0; first < count; first += CHUNK)
+          {
+            size_t size = std::min(CHUNK, count - first), left_num = 0;
+            for (size_t i = first; i < first + size; ++i)
+              {
+                point_type const & point = points[i];
+                result[i] = false;
+                if (point.x < min_corner_.x || point.x > max_corner_.x
+                    || point.y < min_corner_.y || point.y > max_corner_.y
+                    || !in_hull(point))
+                  continue;
+                positions[left_num] = i;
+                left[left_num++] = point;
+              }
+            layout_.descend(left, left_num, node_classes_.data(), nodes);
+            for (size_t k = 0; k < left_num; ++k)
+              result[positions[k]] = node_classes_[nodes[k]] == INSIDE;
+          }
+      }
+
+      kirkpatrick_refinement
+      kirkpatrick_refinement::tuned(std::vector<point_type> const & poly,
+                                    std::vector<point_type> const & sample,
+                                    construction_options const & options)
+      {
+        const size_t thresholds[] = {8, 10, 12, 16, 24};
+        const construction_options::selection_type selections[] =
+          {
+            construction_options::FIFO,
+            construction_options::LOWEST_DEGREE,
+            construction_options::MAX_INDEPENDENT
+          };
+
+        std::unique_ptr<kirkpatrick_refinement> best;
+        double best_cost = std::numeric_limits<double>::max();
+        for (size_t threshold: thresholds)
+          for (auto selection: selections)
+            {
+              construction_options candidate = options;
+              candidate.degree_threshold = threshold;
+              candidate.selection = selection;
+              std::unique_ptr<kirkpatrick_refinement> current(
+                new kirkpatrick_refinement(poly, candidate));
+              query_stats stats;
+              for (point_type const & point: sample)
+                current->find_query(point, stats);
+              // a level costs a dependent memory access, about as much
+              // as a triangle test
+              double cost = stats.average_tests() + stats.average_levels();
+              if (!best || cost < best_cost)
+                {
+                  best_cost = cost;
+                  best = std::move(current);
+                }
+            }
+        return std::move(*best);
+      }
+
+      kirkpatrick_refinement::id_type
+      kirkpatrick_refinement::find_query(point_type const & point) const
+      {
+        no_stats stats;
+        return find_query(point, stats);
       }
 
       kirkpatrick_refinement::id_type
       kirkpatrick_refinement::find_step(point_type const & point, id_type from) const
       {
+        if (compact_)
+          return layout_.original_id(layout_.step(point, layout_.node_of(from)));
+
         for (id_type id: search_dag_.edges[from])
           if (triangle_by_id(id).contains(point))
             return id;
         return from;
       }
 
+      void kirkpatrick_refinement::find_queries(point_type const * points,
+                                                size_t count,
+                                                id_type * result) const
+      {
+        layout_.locate(points, count, result);
+      }
+
+      std::vector<kirkpatrick_refinement::id_type>
+      kirkpatrick_refinement::find_queries(std::vector<point_type> const & points) const
+      {
+        std::vector<id_type> result(points.size());
+        find_queries(points.data(), points.size(), result.data());
+        return result;
+      }
+
+      bool kirkpatrick_refinement::walk(point_type const & point, id_type & id) const
+      {
+        // a dag query takes a few dozen triangle tests
+        const size_t MAX_STEPS = 8;
+        if (id == 0 || id >= level_ends_[0])
+          return false;
+
+        for (size_t step = 0; step < MAX_STEPS; ++step)
+          {
+            auto const & t = search_dag_.vertices[id];
+            const wide_point_type corners[] = {vertex(t.a), vertex(t.b), vertex(t.c)};
+            // leave by the first edge point is beyond, the first edge
+            // rotating with the steps so the walk does not circle
+            size_t k = 0;
+            while (k < 3)
+              {
+                size_t edge = (k + step) % 3;
+                if (turn(corners[edge], corners[(edge + 1) % 3], point) < 0)
+                  break;
+                ++k;
+              }
+            if (k == 3)
+              return true;
+            id = leaf_neighbour(id, (k + step) % 3);
+            if (id == 0)
+              return false;
+          }
+        return false;
+      }
+
+      kirkpatrick_refinement::id_type
+      kirkpatrick_refinement::find_query_near(point_type const & point, id_type hint) const
+      {
+        return walk(point, hint) ? hint : find_query(point);
+      }
+
+      void kirkpatrick_refinement::find_queries_coherent(point_type const * points,
+                                                         size_t count,
+                                                         id_type * result) const
+      {
+        // A failed walk costs its steps on top of the dag query, so after
+        // one the next queries skip the walk, twice as many after each
+        // failure in a row. Skipped queries go through the dag together,
+        // the query after them takes a fresh hint from the dag.
+        const size_t MAX_SKIP = 64;
+        std::vector<size_t> skipped;
+        id_type last = 0;
+        size_t skip = 0, left = 0;
+        for (size_t i = 0; i < count; ++i)
+          {
+            if (left > 0)
+              {
+                --left;
+                skipped.push_back(i);
+                continue;
+              }
+            id_type id = last;
+            if (last != 0 && walk(points[i], id))
+              skip = 0;
+            else
+              {
+                id = find_query(points[i]);
+                if (last != 0)
+                  left = skip = std::min(MAX_SKIP, std::max<size_t>(1, 2 * skip));
+              }
+            result[i] = id;
+            last = left > 0 ? 0 : id;
+          }
+
+        std::vector<point_type> rest(skipped.size());
+        for (size_t k = 0; k < skipped.size(); ++k)
+          rest[k] = points[skipped[k]];
+        std::vector<id_type> found(skipped.size());
+        find_queries(rest.data(), rest.size(), found.data());
+        for (size_t k = 0; k < skipped.size(); ++k)
+          result[skipped[k]] = found[k];
+      }
+
+      void kirkpatrick_refinement::find_queries_sorted(point_type const * points,
+                                                       size_t count,
+                                                       id_type * result) const
+      {
+        if (count == 0)
+          return;
+        // 16 bit cells over the bounding box of the points, enough for
+        // neighbours on the curve to share a leaf
+        const unsigned ORDER = 16;
+        int32_t min_x = points[0].x, max_x = min_x, min_y = points[0].y, max_y = min_y;
+        for (size_t i = 1; i < count; ++i)
+          {
+            min_x = std::min(min_x, points[i].x);
+            max_x = std::max(max_x, points[i].x);
+            min_y = std::min(min_y, points[i].y);
+            max_y = std::max(max_y, points[i].y);
+          }
+        unsigned shift = 0;
+        while ((uint64_t(std::max(int64_t(max_x) - min_x, int64_t(max_y) - min_y)) >> shift)
+               >> ORDER)
+          ++shift;
+
+        // cell index above the point index, radix sorted a byte at a time
+        std::vector<uint64_t> order(count), buffer(count);
+        for (size_t i = 0; i < count; ++i)
+          {
+            uint32_t x = uint32_t(int64_t(points[i].x) - min_x) >> shift;
+            uint32_t y = uint32_t(int64_t(points[i].y) - min_y) >> shift;
+            order[i] = hilbert_index(x, y, ORDER) << 32 | i;
+          }
+        for (unsigned byte = 4; byte < 8; ++byte)
+          {
+            size_t offsets[257] = {0};
+            for (uint64_t key: order)
+              ++offsets[(key >> (8 * byte) & 0xff) + 1];
+            for (size_t k = 1; k < 257; ++k)
+              offsets[k] += offsets[k - 1];
+            for (uint64_t key: order)
+              buffer[offsets[key >> (8 * byte) & 0xff]++] = key;
+            order.swap(buffer);
+          }
+
+        // gathered first, the walk itself then reads and writes in order
+        std::vector<point_type> sorted(count);
+        for (size_t k = 0; k < count; ++k)
+          sorted[k] = points[uint32_t(order[k])];
+        std::vector<id_type> found(count);
+        find_queries_coherent(sorted.data(), count, found.data());
+        for (size_t k = 0; k < count; ++k)
+          result[uint32_t(order[k])] = found[k];
+      }
+
+      void kirkpatrick_refinement::find_raster(raster_type const & raster,
+                                               id_type * labels,
+                                               size_t threads) const
+      {
+        locate_raster(raster, labels, threads, false);
+      }
+
+      void kirkpatrick_refinement::find_faces_raster(raster_type const & raster,
+                                                     id_type * labels,
+                                                     size_t threads) const
+      {
+        locate_raster(raster, labels, threads, true);
+      }
+
+      void kirkpatrick_refinement::locate_raster(raster_type const & raster,
+                                                 id_type * labels,
+                                                 size_t threads,
+                                                 bool faces) const
+      {
+        if (raster.width == 0 || raster.height == 0)
+          return;
+        if (raster.step_x <= 0 || raster.step_y <= 0)
+          throw std::invalid_argument("find_raster: steps must be positive");
+        auto fits = [](int32_t origin, int32_t step, size_t size)
+          {
+            const int64_t max = std::numeric_limits<int32_t>::max();
+            return int64_t(size - 1) <= (max - origin) / step;
+          };
+        if (!fits(raster.origin.x, raster.step_x, raster.width)
+            || !fits(raster.origin.y, raster.step_y, raster.height))
+          throw std::invalid_argument("find_raster: cells out of the int32 range");
+
+        // bands of rows, each started by a dag query
+        const size_t BAND = 16;
+        if (threads <= 1 || raster.height <= BAND)
+          {
+            locate_rows(raster, 0, raster.height, faces, labels);
+            return;
+          }
+        thread_pool pool(threads);
+        pool.parallel_for(raster.height, BAND,
+                          [&](size_t begin, size_t end, size_t)
+                          {
+                            locate_rows(raster, begin, end, faces, labels);
+                          });
+      }
+
+      void kirkpatrick_refinement::locate_rows(raster_type const & raster,
+                                               size_t first, size_t last,
+                                               bool faces, id_type * labels) const
+      {
+        // Where leaves are narrower than cells walks fail; as in
+        // find_queries_coherent the cells after a failure skip the walk
+        // and go through the dag together at the end.
+        const size_t MAX_SKIP = 64;
+        std::vector<point_type> skipped;
+        std::vector<id_type *> skipped_labels;
+        const size_t width = raster.width;
+        const id_type outside = faces ? face_of(0) : 0;
+        auto const & root = search_dag_.vertices[0];
+        // leaf of the first cell of the row before
+        id_type row_hint = 0;
+        for (size_t j = first; j < last; ++j)
+          {
+            const int64_t y = raster.origin.y + int64_t(j) * raster.step_y;
+            id_type * row = labels + j * width;
+            int64_t root_lo, root_hi;
+            row_span(vertex(root.a), vertex(root.b), vertex(root.c), raster, y,
+                     root_lo, root_hi);
+            if (root_lo > root_hi)
+              {
+                std::fill(row, row + width, outside);
+                continue;
+              }
+            std::fill(row, row + root_lo, outside);
+            std::fill(row + root_hi + 1, row + width, outside);
+
+            id_type id = row_hint;
+            size_t skip = 0, left = 0;
+            for (size_t i = root_lo; i <= size_t(root_hi); )
+              {
+                point_type point(int32_t(raster.origin.x + int64_t(i) * raster.step_x),
+                                 int32_t(y));
+                if (left == 0 && id != 0 && !walk(point, id))
+                  {
+                    skip = std::min(2 * skip + 1, MAX_SKIP);
+                    left = skip + 1;
+                    id = 0;
+                  }
+                if (left > 0)
+                  {
+                    --left;
+                    skipped.push_back(point);
+                    skipped_labels.push_back(row + i);
+                    ++i;
+                    continue;
+                  }
+                if (id == 0)
+                  id = find_query(point);
+                else
+                  skip = 0;
+                if (i == size_t(root_lo))
+                  row_hint = id;
+
+                auto const & t = search_dag_.vertices[id];
+                int64_t lo, hi;
+                row_span(vertex(t.a), vertex(t.b), vertex(t.c), raster, y, lo, hi);
+                assert(lo <= int64_t(i) && int64_t(i) <= hi);
+                std::fill(row + i, row + hi + 1, faces ? face_of(id) : id);
+                i = hi + 1;
+              }
+          }
+
+        std::vector<id_type> result(skipped.size());
+        find_queries(skipped.data(), skipped.size(), result.data());
+        for (size_t k = 0; k < skipped.size(); ++k)
+          *skipped_labels[k] = faces ? face_of(result[k]) : result[k];
+      }
+
+      void kirkpatrick_refinement::find_faces(point_type const * points,
+                                              size_t count,
+                                              id_type * result) const
+      {
+        find_queries(points, count, result);
+        for (size_t i = 0; i < count; ++i)
+          result[i] = face_of(result[i]);
+      }
+
+      void kirkpatrick_refinement::order_children(point_type const * queries,
+                                                  size_t count)
+      {
+        layout_.order_children(queries, count);
+        if (compact_)
+          return;
+        for (id_type id = 0; id < triangles_num(); ++id)
+          {
+            id_type node = layout_.node_of(id);
+            auto & children = search_dag_.edges[id];
+            size_t i = 0;
+            layout_.for_each_child(node, [&](id_type child)
+                                   {
+                                     children[i++] = layout_.original_id(child);
+                                   });
+          }
+      }
+
+      void kirkpatrick_refinement::build_grid(size_t memory_budget)
+      {
+        layout_.build_grid(memory_budget);
+      }
+
       bool kirkpatrick_refinement::is_leaf(id_type id) const
       {
         assert(id < triangles_num());
+        if (compact_)
+          return layout_.is_leaf(layout_.node_of(id));
         return search_dag_.edges[id].empty();
       }
 
-      triangle_type<point_type>
+      void kirkpatrick_refinement::compact()
+      {
+        compact_ = true;
+        std::vector<search_dag_type::edges_type>().swap(search_dag_.edges);
+        search_dag_.allocator = nullptr;
+        search_dag_.arena.reset();
+      }
+
+      bool kirkpatrick_refinement::is_compact() const
+      {
+        return compact_;
+      }
+
+      size_t kirkpatrick_refinement::memory_usage() const
+      {
+        size_t result = points_.capacity() * sizeof(point_type)
+          + search_dag_.vertices.capacity() * sizeof(triangle_type<id_type>)
+          + search_dag_.edges.capacity() * sizeof(std::vector<id_type>);
+        for (auto const & children: search_dag_.edges)
+          result += children.capacity() * sizeof(id_type);
+        return result + level_ends_.capacity() * sizeof(size_t)
+          + leaf_neighbours_.capacity() * sizeof(id_type)
+          + face_of_.capacity() * sizeof(id_type)
+          + hull_.capacity() * sizeof(point_type)
+          + node_classes_.capacity()
+          + layout_.memory_usage();
+      }
+
+      double kirkpatrick_refinement::bytes_per_triangle() const
+      {
+        return double(memory_usage()) / triangles_num();
+      }
+
+      triangle_type<wide_point_type>
       kirkpatrick_refinement::triangle_by_id(id_type id) const
       {
         assert(id < triangles_num());
         auto const & t = search_dag_.vertices[id];
-        return triangle_type<point_type>(points_[t.a],
-                                         points_[t.b],
-                                         points_[t.c]);
+        return triangle_type<wide_point_type>(vertex(t.a),
+                                              vertex(t.b),
+                                              vertex(t.c));
       }
 
       size_t kirkpatrick_refinement::triangles_num() const
@@ -212,17 +1093,14 @@ namespace geom
 
       size_t kirkpatrick_refinement::simple_triangles_num() const
       {
-        return points_.size() - 5;
+        return simple_triangles_num_;
       }
 
       kirkpatrick_refinement::id_type
-      kirkpatrick_refinement::add_triangle(triangle_type<id_type> const & t,
-                                           std::vector<set_type> & triangles)
+      kirkpatrick_refinement::add_triangle(triangle_type<id_type> const & t)
       {
         size_t size = search_dag_.vertices.size();
         search_dag_.vertices.push_back(t);
-        for (id_type id: t.to_vector())
-          triangles[id].insert(size);
         return size;
       }
 
@@ -230,33 +1108,37 @@ namespace geom
       kirkpatrick_refinement::is_ear(id_type id1,
                                      id_type id2,
                                      id_type id3,
-                                     std::list<id_type> const & poly) const
+                                     ring_type const & poly) const
       {
-        if (!is_left_turn(points_[id1], points_[id2], points_[id3]))
+        const wide_point_type a = vertex(id1), b = vertex(id2), c = vertex(id3);
+        if (!is_left_turn(a, b, c))
           return false;
 
         for (id_type id: poly) {
           if (id == id1 || id == id2 || id == id3)
             continue;
-          if (triangle_type<point_type>(points_[id1],
-                                        points_[id2],
-                                        points_[id3])
-              .contains(points_[id]))
+          // the corners are never inside
+          if (id < points_.size()
+              && triangle_type<wide_point_type>(a, b, c).contains(points_[id]))
             return false;
         }
         return true;
       }
 
-      std::vector<triangle_type<kirkpatrick_refinement::id_type>>
-      kirkpatrick_refinement::triangulate(std::vector<id_type> const & poly) const
+      void kirkpatrick_refinement::triangulate(std::vector<id_type> const & poly,
+                                               size_t start,
+                                               monotonic_arena & scratch,
+                                               std::vector<triangle_type<id_type>> & result) const
       {
         // ear clipping
-        std::vector<triangle_type<id_type>> result;
         assert(poly.size() >= 3);
-        std::list<id_type> dcvl(poly.begin(), poly.end());
-        std::list<id_type>::iterator v = dcvl.begin();
-        std::advance(v, rand() % dcvl.size());
+        ring_type dcvl(poly.begin(), poly.end(), arena_allocator<id_type>(&scratch));
+        ring_type::iterator v = dcvl.begin();
+        std::advance(v, start % dcvl.size());
 
+        // vertices tried since the last ear; a full round without one
+        // means poly is not simple
+        size_t misses = 0;
         while (dcvl.size() != 3)
           {
             auto v_prev = ::prev(v, dcvl);
@@ -265,58 +1147,165 @@ namespace geom
               {
                 result.emplace_back(*v_prev, *v, *v_next);
                 dcvl.erase(v);
+                misses = 0;
               }
+            else if (++misses == dcvl.size())
+              throw std::invalid_argument("kirkpatrick_refinement: polygon has no ear");
             v = v_next;
           }
 
         result.emplace_back(*dcvl.begin(),
                             *(std::next(dcvl.begin())),
                             *(std::prev(dcvl.end())));
-        return result;
-      }
-
-      kirkpatrick_refinement::id_type
-      kirkpatrick_refinement::next_point(id_type id, id_type t_id) const
-      {
-        auto const & t = search_dag_.vertices[t_id];
-        id_type result = t.a;
-        if (id == t.a)
-          result = t.b;
-        else if (id == t.b)
-          result = t.c;
-        else
-          assert(id == t.c);
-        return result;
       }
 
-      std::vector<kirkpatrick_refinement::id_type>
-      kirkpatrick_refinement::find_independent_set(std::deque<id_type> & from,
-                                                   std::vector<set_type> const & triangles) const
+      void kirkpatrick_refinement::plan_removal(id_type j,
+                                                std::vector<wide_point_type> const & vertices,
+                                                half_edge_mesh const & mesh,
+                                                plan_type & plan,
+                                                removal_type & removal) const
       {
-        size_t size = from.size();
-        std::vector<id_type> result;
-        std::set<id_type> forbidden;
+        const size_t degree = mesh.degree(j);
+        plan.points.resize(degree);
+        plan.adjacent_triangles.resize(degree);
+        mesh.star(j, plan.points.data(), plan.adjacent_triangles.data(), nullptr);
+
+        removal.triangles_begin = plan.triangles.size();
+        if (!triangulation::triangulate_star(vertices, j, plan.points.data(),
+                                             degree, plan.triangles))
+          {
+            // the star is entered at a vertex fixed by j, not by the thread
+            triangulate(plan.points, j, plan.scratch, plan.triangles);
+            plan.scratch.release();
+          }
+        removal.triangles_end = plan.triangles.size();
 
-        id_type j = from.front();
-        for (size_t i = 0; i < size; ++i)
+        // Old triangle k is the part of the star between the rays from j
+        // through link[k] and link[k + 1], link being in angular order.
+        // A new triangle (x, y, w) with j right of or on x -> y spans the
+        // sectors from y around to x; one with j inside spans all.
+        auto position = [&](id_type v) -> size_t
+        {
+          return std::find(plan.points.begin(), plan.points.end(), v) - plan.points.begin();
+        };
+        wide_point_type const & center = vertices[j];
+        removal.overlaps_begin = plan.overlaps.size();
+        for (uint32_t i = 0; i < removal.triangles_end - removal.triangles_begin; ++i)
           {
-            assert(triangles[j].size() < DEGREE_THRESHOLD);
-            from.pop_front();
-            if (forbidden.find(j) == forbidden.end())
+            auto const & t = plan.triangles[removal.triangles_begin + i];
+            const id_type corners[] = {t.a, t.b, t.c};
+            size_t first = 0, count = degree;
+            for (size_t e = 0; e < 3; ++e)
               {
-                result.push_back(j);
-                for (auto i: triangles[j])
+                id_type x = corners[e], y = corners[(e + 1) % 3];
+                if (turn(vertices[x], vertices[y], center) <= 0)
                   {
-                    auto p = next_point(j, i);
-                    forbidden.insert(p);
-                    forbidden.insert(next_point(p, i));
+                    first = position(y);
+                    count = (position(x) + degree - first) % degree;
+                    break;
                   }
               }
-            else
-              from.push_back(j);
-            j = from.front();
+            for (size_t k = 0; k < degree; ++k)
+              if ((k + degree - first) % degree < count)
+                {
+                  id_type old = plan.adjacent_triangles[k];
+#ifdef KIRKPATRICK_CHECK_LINKS
+                  assert(triangle_by_id(old).intersects(
+                           triangle_type<wide_point_type>(vertices[t.a], vertices[t.b],
+                                                          vertices[t.c])));
+#endif
+                  plan.overlaps.emplace_back(i, old);
+                }
+          }
+        removal.overlaps_end = plan.overlaps.size();
+      }
+
+      std::vector<kirkpatrick_refinement::id_type>
+      kirkpatrick_refinement::find_independent_set(std::vector<id_type> & from,
+                                                   half_edge_mesh const & mesh,
+                                                   std::mt19937 & random,
+                                                   std::vector<bool> & marks) const
+      {
+        const size_t DEGREE_THRESHOLD = options_.degree_threshold;
+        std::vector<id_type> candidates;
+        candidates.reserve(from.size());
+        for (id_type j: from)
+          // a vertex may be queued twice, the copy left after its removal is dropped
+          if (mesh.degree(j) != 0)
+            {
+              assert(mesh.degree(j) < DEGREE_THRESHOLD);
+              candidates.push_back(j);
+            }
+        from.clear();
+
+        std::vector<id_type> link(DEGREE_THRESHOLD);
+        switch (options_.selection)
+          {
+          case construction_options::FIFO:
+            break;
+          case construction_options::LOWEST_DEGREE:
+            std::stable_sort(candidates.begin(), candidates.end(),
+                             [&](id_type l, id_type r)
+                             {
+                               return mesh.degree(l) < mesh.degree(r);
+                             });
+            break;
+          case construction_options::RANDOMIZED:
+            // Fisher-Yates on the raw engine output, which the standard
+            // fixes, unlike std::shuffle
+            for (size_t i = candidates.size(); i > 1; --i)
+              std::swap(candidates[i - 1], candidates[random() % i]);
+            break;
+          case construction_options::MAX_INDEPENDENT:
+            {
+              // a picked vertex blocks its low degree neighbours
+              for (id_type j: candidates)
+                marks[j] = true;
+              std::vector<std::pair<size_t, id_type>> blocked;
+              blocked.reserve(candidates.size());
+              for (id_type j: candidates)
+                {
+                  size_t degree = mesh.link(j, link.data());
+                  size_t count = 0;
+                  for (size_t i = 0; i < degree; ++i)
+                    count += marks[link[i]];
+                  blocked.emplace_back(count * DEGREE_THRESHOLD + degree, j);
+                }
+              for (id_type j: candidates)
+                marks[j] = false;
+              std::stable_sort(blocked.begin(), blocked.end(),
+                               [](std::pair<size_t, id_type> const & l,
+                                  std::pair<size_t, id_type> const & r)
+                               {
+                                 return l.first < r.first;
+                               });
+              for (size_t i = 0; i < blocked.size(); ++i)
+                candidates[i] = blocked[i].second;
+            }
+            break;
           }
 
+        // marks holds the picked vertices and their neighbours
+        std::vector<id_type> result;
+        for (id_type j: candidates)
+          if (!marks[j])
+            {
+              result.push_back(j);
+              marks[j] = true;
+              size_t degree = mesh.link(j, link.data());
+              for (size_t i = 0; i < degree; ++i)
+                marks[link[i]] = true;
+            }
+          else
+            from.push_back(j);
+
+        for (id_type j: result)
+          {
+            marks[j] = false;
+            size_t degree = mesh.link(j, link.data());
+            for (size_t i = 0; i < degree; ++i)
+              marks[link[i]] = false;
+          }
         return result;
       }
 
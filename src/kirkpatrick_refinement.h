@@ -2,13 +2,17 @@
 #define _KIRKPATRICK_REFINEMENT_H
 
 #include "graph.h"
+#include "half_edge_mesh.h"
 #include "triangle.h"
+#include "wide_point.h"
+#include "query_layout.h"
 #include "geom/primitives/contour.h"
 
-#include <set>
+#include <list>
+#include <memory>
 #include <vector>
-#include <deque>
 #include <functional>
+#include <random>
 
 namespace geom
 {
@@ -17,59 +21,394 @@ namespace geom
     namespace localization
     {
       using geom::structures::point_type;
+      using geom::structures::wide_point_type;
       using geom::structures::contour_type;
       using geom::structures::graph_type;
       using geom::structures::triangle_type;
+      using geom::structures::half_edge_mesh;
+      using geom::structures::monotonic_arena;
+      using geom::structures::arena_allocator;
+
+      struct construction_options
+      {
+        // order in which low degree vertices enter the independent set
+        enum selection_type
+          {
+            // as they became low degree
+            FIFO,
+            // smallest stars first, giving fewer children per triangle
+            LOWEST_DEGREE,
+            // shuffled by seed
+            RANDOMIZED,
+            // fewest low degree neighbours first, a greedy heuristic for
+            // large independent sets and so fewer levels
+            MAX_INDEPENDENT
+          };
+
+        // threads retriangulating the stars of one level, the result does
+        // not depend on it
+        size_t threads = 1;
+        // vertices of lower degree are removed; higher thresholds give
+        // fewer levels with more children per triangle. At least 7, which
+        // guarantees progress, and at most MAX_STAR_SIZE + 1.
+        size_t degree_threshold = 12;
+        selection_type selection = FIFO;
+        // seeds RANDOMIZED and the ear clipping of degenerate polygons;
+        // the same points and options give the same dag on every run
+        // and platform, see dag_statistics::hash
+        uint32_t seed = 1;
+      };
+
+      // Grid of sample points, cell (i, j) at origin + (i step_x, j step_y)
+      // for i < width and j < height. Every cell must have int32
+      // coordinates.
+      struct raster_type
+      {
+        point_type origin;
+        int32_t step_x = 1;
+        int32_t step_y = 1;
+        size_t width = 0;
+        size_t height = 0;
+      };
 
       struct kirkpatrick_refinement
       {
         typedef uint32_t id_type;
-        const size_t DEGREE_THRESHOLD = 12;
+        static const id_type NO_FACE = id_type(-1);
+
+        kirkpatrick_refinement(std::vector<point_type> const & poly,
+                               construction_options const & options = construction_options());
+        // takes the points over without a copy
+        kirkpatrick_refinement(std::vector<point_type> && poly,
+                               construction_options const & options = construction_options());
+
+        kirkpatrick_refinement(kirkpatrick_refinement const & other) = default;
+        kirkpatrick_refinement & operator =(kirkpatrick_refinement const & other) = default;
+        kirkpatrick_refinement(kirkpatrick_refinement && other) = default;
+        kirkpatrick_refinement & operator =(kirkpatrick_refinement && other) = default;
 
-        kirkpatrick_refinement(std::vector<point_type> const & poly);
+        // Planar subdivision: counter clockwise faces over points, which
+        // may share vertices and edges but must not overlap. Every point
+        // lies in the face whose triangles contain it, see face_of.
+        // Throws std::invalid_argument on faces with coincident vertices
+        // or crossing edges.
+        kirkpatrick_refinement(std::vector<point_type> const & points,
+                               std::vector<std::vector<id_type>> const & faces,
+                               construction_options const & options = construction_options());
+        kirkpatrick_refinement(std::vector<point_type> && points,
+                               std::vector<std::vector<id_type>> const & faces,
+                               construction_options const & options = construction_options());
+
+        // Builds poly with each degree threshold and selection policy
+        // worth trying and keeps the structure answering sample with the
+        // fewest triangle tests and levels. Threads and seed come from
+        // options.
+        static kirkpatrick_refinement
+        tuned(std::vector<point_type> const & poly,
+              std::vector<point_type> const & sample,
+              construction_options const & options = construction_options());
+
+        construction_options const & options() const
+        {
+          return options_;
+        }
 
         id_type find_query(point_type const & point) const;
+
+        // find_query reporting the levels walked and triangles tested to
+        // a statistics policy, see query_stats.h
+        template <typename Stats>
+        id_type find_query(point_type const & point, Stats & stats) const;
+
         id_type find_step(point_type const & point, id_type from = 0) const;
+
+        // locates count points at once, walking them through the dag
+        // together with vectorized child tests where the cpu allows
+        void find_queries(point_type const * points, size_t count,
+                          id_type * result) const;
+        std::vector<id_type> find_queries(std::vector<point_type> const & points) const;
+
+        // Leaf containing point, found by walking the leaves from hint,
+        // the answer to a nearby earlier query, and from the root when
+        // that takes more than a few steps. Any id is a valid hint. On
+        // edges the leaf may differ from the one find_query gives.
+        id_type find_query_near(point_type const & point, id_type hint) const;
+
+        // locates a stream of close points, like a track or a scan, each
+        // from the answer to the one before
+        void find_queries_coherent(point_type const * points, size_t count,
+                                   id_type * result) const;
+        // locates the points as a stream in Hilbert curve order, result
+        // follows the order of points
+        void find_queries_sorted(point_type const * points, size_t count,
+                                 id_type * result) const;
+
+        // Labels cell (i, j) of raster with the leaf containing it at
+        // labels[j width + i]. Rows walk the leaves from cell to cell and
+        // label the cells a leaf covers at once; bands of rows go to
+        // threads. On edges the leaf may differ from the one find_query
+        // gives. Throws std::invalid_argument on a bad raster.
+        void find_raster(raster_type const & raster, id_type * labels,
+                         size_t threads = 1) const;
+        // find_raster labelling cells with faces
+        void find_faces_raster(raster_type const & raster, id_type * labels,
+                               size_t threads = 1) const;
+
+        // leaf across edge (a, b), (b, c) or (c, a) of a leaf, 0 outside
+        // the bounding triangle
+        id_type leaf_neighbour(id_type leaf, size_t edge) const
+        {
+          return leaf_neighbours_[3 * leaf + edge];
+        }
+
         bool is_leaf(id_type) const;
 
+        // face of a leaf triangle, NO_FACE outside all faces; the single
+        // polygon is face 0
+        id_type face_of(id_type id) const
+        {
+          return id < face_of_.size() ? face_of_[id] : NO_FACE;
+        }
+
+        id_type find_face(point_type const & point) const
+        {
+          return face_of(find_query(point));
+        }
+
+        void find_faces(point_type const * points, size_t count,
+                        id_type * result) const;
+
+        // Whether point lies in a face. Points outside the bounding box
+        // or the convex hull of the points are rejected without the dag,
+        // and the descent stops at the first triangle wholly inside or
+        // outside the faces. Points on face boundaries may go either way.
+        bool classify(point_type const & point) const;
+        void classify(point_type const * points, size_t count, bool * result) const;
+
+        std::vector<id_type> const & faces_table() const
+        {
+          return face_of_;
+        }
+
+        // Children are tried in the order of the share of their parent
+        // they cover. This reorders them by how often queries distributed
+        // like queries, a recorded query log, reach them, keeping that
+        // order where queries do not tell. Answers do not change.
+        void order_children(point_type const * queries, size_t count);
+
+        // Starts queries from a grid of at most memory_budget bytes over
+        // the bounding triangle, see query_layout::build_grid; queries in
+        // a leaf cell take one lookup. 0 drops the grid. On edges the leaf
+        // found may change.
+        void build_grid(size_t memory_budget);
+
+        // Drops the construction graph edges and answers every query from
+        // the frozen layout; search_dag().edges is empty afterwards.
+        void compact();
+        bool is_compact() const;
+
+        query_layout const & layout() const
+        {
+          return layout_;
+        }
+
+        size_t memory_usage() const;
+        double bytes_per_triangle() const;
+
+        // ids [level_ends()[i - 1], level_ends()[i]) were added by level i,
+        // level 0 is the initial triangulation and the root
+        std::vector<size_t> const & level_ends() const
+        {
+          return level_ends_;
+        }
+
         size_t triangles_num() const;
         size_t simple_triangles_num() const;
 
-        triangle_type<point_type> triangle_by_id(id_type id) const;
+        triangle_type<wide_point_type> triangle_by_id(id_type id) const;
 
+        // the input points, vertices [0, points().size())
         std::vector<point_type> const & points() const
         {
           return points_;
         }
 
-        graph_type<triangle_type<id_type>> const & search_dag() const
+        // Input point, or corner of the bounding triangle for ids from
+        // points().size() on. The corners may lie outside the int32
+        // range.
+        wide_point_type vertex(id_type id) const
+        {
+          return id < points_.size() ? wide_point_type(points_[id])
+                                     : corners_[id - points_.size()];
+        }
+
+        // the input points followed by the corners
+        std::vector<wide_point_type> vertices() const;
+
+        search_dag_type const & search_dag() const
         {
           return search_dag_;
         };
 
       private:
+        // The search dag with the arena its edge lists are carved from.
+        // Copies take the edge lists to the heap and get no arena, so the
+        // refinement copies like any value.
+        struct arena_dag_type : search_dag_type
+        {
+          arena_dag_type() {}
+
+          arena_dag_type(arena_dag_type const & other)
+            : search_dag_type(other)
+          {
+            allocator = nullptr;
+          }
+
+          arena_dag_type(arena_dag_type && other) = default;
+
+          arena_dag_type & operator =(arena_dag_type const & other)
+          {
+            // assigning the edge lists in place would allocate from the
+            // arena dropped along
+            if (this != &other)
+              *this = arena_dag_type(other);
+            return *this;
+          }
+
+          arena_dag_type & operator =(arena_dag_type && other) = default;
+
+          std::shared_ptr<monotonic_arena> arena;
+        };
+
+      private:
+        construction_options options_;
         std::vector<point_type> points_;
-        graph_type<triangle_type<id_type>> search_dag_;
+        // the bounding triangle, vertices n, n + 1 and n + 2
+        wide_point_type corners_[3];
+        arena_dag_type search_dag_;
+
+        std::vector<size_t> level_ends_;
+        // three per leaf, see leaf_neighbour
+        std::vector<id_type> leaf_neighbours_;
+        // face of every leaf, ids [1, simple_triangles_num_] lie in faces
+        std::vector<id_type> face_of_;
+        size_t simple_triangles_num_ = 0;
+
+        query_layout layout_;
+        bool compact_ = false;
+
+        // classify: bounding box and counter clockwise convex hull of the
+        // points, and per layout node whether its triangle is wholly in
+        // the faces, wholly out, or MIXED
+        enum
+          {
+            MIXED,
+            OUTSIDE,
+            INSIDE
+          };
+        point_type min_corner_, max_corner_;
+        std::vector<point_type> hull_;
+        std::vector<uint8_t> node_classes_;
 
       private:
-        typedef std::set<id_type> set_type;
+        // capacity for the hierarchy over n points
+        void reserve(size_t n);
+        void check_options() const;
+        void add_bounding_triangle();
+        double polygon_area(std::vector<id_type> const & poly) const;
+        // throws unless the face edges meet only at shared vertices
+        void check_faces(std::vector<std::vector<id_type>> const & faces,
+                         std::vector<wide_point_type> const & vertices) const;
+        // rings around the region not covered by faces, for triangulate_region
+        void boundary_rings(std::vector<std::vector<id_type>> const & faces,
+                            std::vector<std::vector<id_type>> & rings) const;
+        // removes independent sets of input points until only the
+        // bounding triangle is left
+        void build_hierarchy(std::vector<wide_point_type> const & vertices);
+        // sets up classify over the first n points
+        void build_classes(id_type n);
+        bool in_hull(point_type const & point) const;
+        // moves id, a leaf, across edges towards point; false when point
+        // is not reached in a few steps
+        bool walk(point_type const & point, id_type & id) const;
+        // labels rows [first, last) of raster, with faces when faces is set
+        void locate_rows(raster_type const & raster, size_t first, size_t last,
+                         bool faces, id_type * labels) const;
+        void locate_raster(raster_type const & raster, id_type * labels,
+                           size_t threads, bool faces) const;
+
+        id_type add_triangle(triangle_type<id_type> const & t);
 
-        id_type add_triangle(triangle_type<id_type> const & t,
-                             std::vector<set_type> & triangles);
+        typedef std::list<id_type, arena_allocator<id_type>> ring_type;
 
         bool is_ear(id_type id1, id_type id2, id_type id3,
-                    std::list<id_type> const & poly) const;
+                    ring_type const & poly) const;
 
-        std::vector<triangle_type<id_type>>
-        triangulate(std::vector<id_type> const & poly) const;
+        // appends an ear clipping of poly to result, the ring is kept in
+        // scratch; throws std::invalid_argument when poly has no ear
+        void triangulate(std::vector<id_type> const & poly, size_t start,
+                         monotonic_arena & scratch,
+                         std::vector<triangle_type<id_type>> & result) const;
 
-        id_type next_point(id_type id, id_type t_id) const;
+        // Retriangulations of stars planned by one worker during a level,
+        // one after another. The buffers keep their capacity across
+        // levels.
+        struct plan_type
+        {
+          std::vector<id_type> points;
+          std::vector<id_type> adjacent_triangles;
+          std::vector<triangle_type<id_type>> triangles;
+          // new triangle index within its star and the old triangle it
+          // overlaps
+          std::vector<std::pair<uint32_t, id_type>> overlaps;
+          monotonic_arena scratch;
+        };
+
+        // retriangulation of the star of a vertex, planned before the
+        // vertex is removed from the mesh, within the plan of worker
+        struct removal_type
+        {
+          size_t worker;
+          size_t triangles_begin, triangles_end;
+          size_t overlaps_begin, overlaps_end;
+        };
+
+        void plan_removal(id_type j, std::vector<wide_point_type> const & vertices,
+                          half_edge_mesh const & mesh,
+                          plan_type & plan, removal_type & removal) const;
 
+        // marks has an entry per vertex, all false, and is left so
         std::vector<id_type>
-        find_independent_set(std::deque<id_type> & from,
-                             std::vector<set_type> const & triangles) const;
+        find_independent_set(std::vector<id_type> & from,
+                             half_edge_mesh const & mesh,
+                             std::mt19937 & random,
+                             std::vector<bool> & marks) const;
       };
 
+      template <typename Stats>
+      kirkpatrick_refinement::id_type
+      kirkpatrick_refinement::find_query(point_type const & point, Stats & stats) const
+      {
+        if (compact_ || layout_.has_grid())
+          return layout_.locate(point, stats);
+
+        stats.begin();
+        id_type id = 0;
+        while (true)
+          {
+            auto const & children = search_dag_.edges[id];
+            size_t i = 0;
+            while (i < children.size() && !triangle_by_id(children[i]).contains(point))
+              ++i;
+            stats.test(i == children.size() ? i : i + 1);
+            if (i == children.size())
+              break;
+            stats.descend();
+            id = children[i];
+          }
+        stats.end();
+        return id;
+      }
     }
   }
 }
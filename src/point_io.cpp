@@ -0,0 +1,192 @@
+#include "point_io.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace geom
+{
+  namespace algorithms
+  {
+    namespace localization
+    {
+      namespace
+      {
+        const char POINTS_MAGIC[4] = {'K', 'P', 'T', 'S'};
+        const size_t HEADER_SIZE = 16;
+
+        // read-only mapping of a whole file, unmapped on destruction
+        struct mapped_file
+        {
+          explicit mapped_file(std::string const & path)
+          {
+            int fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0)
+              throw std::runtime_error("load_points: cannot open " + path
+                                       + ": " + std::strerror(errno));
+            struct stat info;
+            if (::fstat(fd, &info) != 0)
+              {
+                int error = errno;
+                ::close(fd);
+                throw std::runtime_error("load_points: cannot stat " + path
+                                         + ": " + std::strerror(error));
+              }
+            size = info.st_size;
+            if (size == 0)
+              {
+                ::close(fd);
+                return;
+              }
+            void * data = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            int error = errno;
+            ::close(fd);
+            if (data == MAP_FAILED)
+              throw std::runtime_error("load_points: cannot map " + path
+                                       + ": " + std::strerror(error));
+            ::madvise(data, size, MADV_SEQUENTIAL);
+            bytes = static_cast<char const *>(data);
+          }
+
+          ~mapped_file()
+          {
+            if (bytes)
+              ::munmap(const_cast<char *>(bytes), size);
+          }
+
+          mapped_file(mapped_file const &) = delete;
+          mapped_file & operator =(mapped_file const &) = delete;
+
+          char const * bytes = nullptr;
+          size_t size = 0;
+        };
+
+        uint32_t get32(char const * bytes)
+        {
+          unsigned char const * u = reinterpret_cast<unsigned char const *>(bytes);
+          return uint32_t(u[0]) | uint32_t(u[1]) << 8 | uint32_t(u[2]) << 16
+            | uint32_t(u[3]) << 24;
+        }
+
+        void put32(char * bytes, uint32_t value)
+        {
+          for (size_t i = 0; i < 4; ++i)
+            bytes[i] = char(value >> (8 * i));
+        }
+
+        void load_binary(mapped_file const & file, std::string const & path,
+                         std::vector<point_type> & result)
+        {
+          if (file.size < HEADER_SIZE)
+            throw std::runtime_error("load_points: " + path + " is truncated");
+          uint32_t version = get32(file.bytes + 4);
+          if (version != POINTS_FORMAT_VERSION)
+            throw std::runtime_error("load_points: " + path + ": unsupported version "
+                                     + std::to_string(version));
+          uint64_t count = get32(file.bytes + 8) | uint64_t(get32(file.bytes + 12)) << 32;
+          if (count > (file.size - HEADER_SIZE) / 8
+              || HEADER_SIZE + 8 * count != file.size)
+            throw std::runtime_error("load_points: " + path + ": size does not match "
+                                     "the point count");
+          result.resize(count);
+          char const * at = file.bytes + HEADER_SIZE;
+          for (point_type & p: result)
+            {
+              p = point_type(int32_t(get32(at)), int32_t(get32(at + 4)));
+              at += 8;
+            }
+        }
+
+        void load_text(mapped_file const & file, std::string const & path,
+                       std::vector<point_type> & result)
+        {
+          char const * at = file.bytes;
+          char const * end = at + file.size;
+          // usually a point per line
+          size_t lines = std::count(at, end, '\n');
+          result.reserve(lines + 1);
+
+          int32_t coordinates[2];
+          size_t parsed = 0;
+          while (true)
+            {
+              while (at != end && !(*at >= '0' && *at <= '9')
+                     && !(*at == '-' && at + 1 != end && at[1] >= '0' && at[1] <= '9'))
+                ++at;
+              if (at == end)
+                break;
+              bool negative = *at == '-';
+              if (negative)
+                ++at;
+              // magnitudes up to 2^31 for INT32_MIN
+              const uint64_t limit = uint64_t(std::numeric_limits<int32_t>::max()) + negative;
+              uint64_t value = 0;
+              for (; at != end && *at >= '0' && *at <= '9'; ++at)
+                {
+                  value = 10 * value + (*at - '0');
+                  if (value > limit)
+                    throw std::runtime_error("load_points: " + path
+                                             + ": coordinate out of the int32 range");
+                }
+              coordinates[parsed++ % 2] = negative ? int32_t(-int64_t(value)) : int32_t(value);
+              if (parsed % 2 == 0)
+                result.push_back(point_type(coordinates[0], coordinates[1]));
+            }
+          if (parsed % 2 != 0)
+            throw std::runtime_error("load_points: " + path + ": odd number of coordinates");
+        }
+      }
+
+      std::vector<point_type> load_points(std::string const & path)
+      {
+        mapped_file file(path);
+        std::vector<point_type> result;
+        if (file.size >= sizeof(POINTS_MAGIC)
+            && std::memcmp(file.bytes, POINTS_MAGIC, sizeof(POINTS_MAGIC)) == 0)
+          load_binary(file, path, result);
+        else
+          load_text(file, path, result);
+        return result;
+      }
+
+      void save_points(std::vector<point_type> const & points, std::string const & path)
+      {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        if (!out)
+          throw std::runtime_error("save_points: cannot open " + path);
+
+        char header[HEADER_SIZE];
+        std::memcpy(header, POINTS_MAGIC, sizeof(POINTS_MAGIC));
+        put32(header + 4, POINTS_FORMAT_VERSION);
+        put32(header + 8, uint32_t(uint64_t(points.size())));
+        put32(header + 12, uint32_t(uint64_t(points.size()) >> 32));
+        out.write(header, HEADER_SIZE);
+
+        std::vector<char> buffer;
+        const size_t BUFFER_POINTS = 1 << 13;
+        for (size_t first = 0; first < points.size(); first += BUFFER_POINTS)
+          {
+            size_t count = std::min(BUFFER_POINTS, points.size() - first);
+            buffer.resize(8 * count);
+            for (size_t i = 0; i < count; ++i)
+              {
+                put32(buffer.data() + 8 * i, uint32_t(points[first + i].x));
+                put32(buffer.data() + 8 * i + 4, uint32_t(points[first + i].y));
+              }
+            out.write(buffer.data(), buffer.size());
+          }
+        out.flush();
+        if (!out)
+          throw std::runtime_error("save_points: cannot write " + path);
+      }
+    }
+  }
+}
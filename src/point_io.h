@@ -0,0 +1,33 @@
+#ifndef _POINT_IO_H
+#define _POINT_IO_H
+
+#include "geom/primitives/point.h"
+
+#include <string>
+#include <vector>
+
+namespace geom
+{
+  namespace algorithms
+  {
+    namespace localization
+    {
+      using geom::structures::point_type;
+
+      // Binary point file: the magic "KPTS", a 32-bit version and a
+      // 64-bit count, then x, y per point as 32-bit words, all little
+      // endian.
+      const uint32_t POINTS_FORMAT_VERSION = 1;
+
+      // Loads a binary point file or text with two integers per point,
+      // like the "(x, y)" lines the viewer saves; anything else between
+      // the numbers is skipped. The file is mapped and parsed in place.
+      // Throws std::runtime_error on unreadable or malformed files.
+      std::vector<point_type> load_points(std::string const & path);
+
+      void save_points(std::vector<point_type> const & points, std::string const & path);
+    }
+  }
+}
+
+#endif // _POINT_IO_H
@@ -0,0 +1,655 @@
+#include "polygon_triangulation.h"
+#include "arena.h"
+#include "turn.h"
+
+#include <algorithm>
+#include <cassert>
+#include <numeric>
+#include <set>
+
+namespace geom
+{
+  namespace algorithms
+  {
+    namespace triangulation
+    {
+      namespace
+      {
+        // sweep order, ties broken by x as if the plane were slightly
+        // rotated, so no edge is horizontal
+        bool above(wide_point_type const & p, wide_point_type const & q)
+        {
+          return p.y > q.y || (p.y == q.y && p.x < q.x);
+        }
+
+        // whether the edge from upper l to lower l runs west of the one
+        // from upper r to lower r, compared at the upper end of the edge
+        // starting lower
+        bool west_of(wide_point_type const & upper_l, wide_point_type const & lower_l,
+                     wide_point_type const & upper_r, wide_point_type const & lower_r)
+        {
+          // turn is positive when the point is east of the edge
+          if (!above(upper_r, upper_l))
+            {
+              int s = turn(upper_l, lower_l, upper_r);
+              if (s == 0)
+                s = turn(upper_l, lower_l, lower_r);
+              return s > 0;
+            }
+          int s = turn(upper_r, lower_r, upper_l);
+          if (s == 0)
+            s = turn(upper_r, lower_r, lower_l);
+          return s < 0;
+        }
+
+        const size_t QUERY = size_t(-1);
+
+        // Sweep status: edges i -> next[i] going down with the interior
+        // on their right, ordered from west to east. QUERY stands for the
+        // point *query.
+        struct edge_less
+        {
+          std::vector<wide_point_type> const * points;
+          std::vector<id_type> const * poly;
+          std::vector<size_t> const * next;
+          wide_point_type const * query;
+
+          wide_point_type const & upper(size_t e) const
+          {
+            return (*points)[(*poly)[e]];
+          }
+
+          wide_point_type const & lower(size_t e) const
+          {
+            return (*points)[(*poly)[(*next)[e]]];
+          }
+
+          bool operator ()(size_t l, size_t r) const
+          {
+            if (l == r)
+              return false;
+            if (l == QUERY)
+              return turn(upper(r), lower(r), *query) < 0;
+            if (r == QUERY)
+              return turn(upper(l), lower(l), *query) > 0;
+            return west_of(upper(l), lower(l), upper(r), lower(r));
+          }
+        };
+
+        enum vertex_kind { START, END, SPLIT, MERGE, REGULAR };
+
+        // Diagonals splitting the region left of the rings into y-monotone
+        // pieces. The rings are given by the successor next[i] of every
+        // position i in poly, prev is its inverse.
+        bool make_monotone(std::vector<wide_point_type> const & points,
+                           std::vector<id_type> const & poly,
+                           std::vector<size_t> const & next,
+                           std::vector<size_t> const & prev,
+                           std::vector<std::pair<size_t, size_t>> & diagonals)
+        {
+          const size_t n = poly.size();
+          auto at = [&](size_t i) -> wide_point_type const & { return points[poly[i]]; };
+
+          std::vector<vertex_kind> kind(n);
+          for (size_t i = 0; i < n; ++i)
+            {
+              bool prev_below = above(at(i), at(prev[i]));
+              bool next_below = above(at(i), at(next[i]));
+              bool convex = is_left_turn(at(prev[i]), at(i), at(next[i]));
+              if (prev_below && next_below)
+                kind[i] = convex ? START : SPLIT;
+              else if (!prev_below && !next_below)
+                kind[i] = convex ? END : MERGE;
+              else
+                kind[i] = REGULAR;
+            }
+
+          std::vector<size_t> order(n);
+          std::iota(order.begin(), order.end(), 0);
+          std::sort(order.begin(), order.end(), [&](size_t l, size_t r)
+                    {
+                      return above(at(l), at(r));
+                    });
+
+          // status nodes come from an arena, one heap block per doubling
+          wide_point_type query;
+          structures::monotonic_arena arena;
+          typedef std::set<size_t, edge_less, structures::arena_allocator<size_t>> status_type;
+          status_type status(edge_less{&points, &poly, &next, &query},
+                             structures::arena_allocator<size_t>(&arena));
+          std::vector<status_type::iterator> position(n, status.end());
+          std::vector<size_t> helper(n);
+
+          auto insert = [&](size_t e)
+          {
+            position[e] = status.insert(e).first;
+            helper[e] = e;
+          };
+          auto erase = [&](size_t e)
+          {
+            if (position[e] == status.end())
+              return false;
+            status.erase(position[e]);
+            position[e] = status.end();
+            return true;
+          };
+          auto connect_merge = [&](size_t e, size_t v)
+          {
+            if (kind[helper[e]] == MERGE)
+              diagonals.emplace_back(v, helper[e]);
+          };
+          // edge directly west of vertex v
+          auto left_of = [&](size_t v, size_t & e)
+          {
+            query = at(v);
+            auto it = status.lower_bound(QUERY);
+            if (it == status.begin())
+              return false;
+            e = *--it;
+            return true;
+          };
+
+          for (size_t v: order)
+            {
+              size_t before = prev[v];
+              size_t e;
+              switch (kind[v])
+                {
+                case START:
+                  insert(v);
+                  break;
+                case END:
+                  connect_merge(before, v);
+                  if (!erase(before))
+                    return false;
+                  break;
+                case SPLIT:
+                  if (!left_of(v, e))
+                    return false;
+                  diagonals.emplace_back(v, helper[e]);
+                  helper[e] = v;
+                  insert(v);
+                  break;
+                case MERGE:
+                  connect_merge(before, v);
+                  if (!erase(before) || !left_of(v, e))
+                    return false;
+                  connect_merge(e, v);
+                  helper[e] = v;
+                  break;
+                case REGULAR:
+                  if (above(at(before), at(v)))
+                    {
+                      // interior lies east of v
+                      connect_merge(before, v);
+                      if (!erase(before))
+                        return false;
+                      insert(v);
+                    }
+                  else
+                    {
+                      if (!left_of(v, e))
+                        return false;
+                      connect_merge(e, v);
+                      helper[e] = v;
+                    }
+                  break;
+                }
+            }
+          return true;
+        }
+
+        // Counter clockwise faces of the rings cut by the diagonals, as
+        // lists of positions in poly one after another; face i ends at
+        // face_ends[i].
+        bool split_faces(std::vector<wide_point_type> const & points,
+                         std::vector<id_type> const & poly,
+                         std::vector<size_t> const & next,
+                         std::vector<std::pair<size_t, size_t>> const & diagonals,
+                         std::vector<size_t> & faces,
+                         std::vector<size_t> & face_ends)
+        {
+          const size_t n = poly.size();
+          auto at = [&](size_t i) -> wide_point_type const & { return points[poly[i]]; };
+
+          // half-edges: i -> next[i] inside, then their twins outside,
+          // then both directions of every diagonal
+          std::vector<size_t> origin, target;
+          for (size_t i = 0; i < n; ++i)
+            {
+              origin.push_back(i);
+              target.push_back(next[i]);
+            }
+          for (size_t i = 0; i < n; ++i)
+            {
+              origin.push_back(next[i]);
+              target.push_back(i);
+            }
+          for (auto const & d: diagonals)
+            {
+              origin.push_back(d.first);  target.push_back(d.second);
+              origin.push_back(d.second); target.push_back(d.first);
+            }
+          const size_t edges_num = origin.size();
+          auto twin = [&](size_t h)
+          {
+            if (h < 2 * n)
+              return h < n ? h + n : h - n;
+            return h % 2 == 0 ? h + 1 : h - 1;
+          };
+
+          // outgoing half-edges of every vertex in counter clockwise order
+          std::vector<size_t> sorted(edges_num);
+          std::iota(sorted.begin(), sorted.end(), 0);
+          std::sort(sorted.begin(), sorted.end(), [&](size_t l, size_t r)
+                    {
+                      if (origin[l] != origin[r])
+                        return origin[l] < origin[r];
+                      wide_point_type const & o = at(origin[l]);
+                      bool l_upper = above(o, at(target[l])) == false;
+                      bool r_upper = above(o, at(target[r])) == false;
+                      if (l_upper != r_upper)
+                        return l_upper;
+                      return turn(o, at(target[l]), at(target[r])) > 0;
+                    });
+          std::vector<size_t> position(edges_num), first(n + 1, 0);
+          for (size_t k = 0; k < edges_num; ++k)
+            position[sorted[k]] = k;
+          for (size_t h = 0; h < edges_num; ++h)
+            ++first[origin[h] + 1];
+          std::partial_sum(first.begin(), first.end(), first.begin());
+
+          // the face left of u -> v goes on with the first edge of v
+          // clockwise from v -> u
+          auto face_next = [&](size_t h)
+          {
+            size_t t = twin(h);
+            size_t v = origin[t];
+            size_t k = position[t];
+            return sorted[k == first[v] ? first[v + 1] - 1 : k - 1];
+          };
+
+          std::vector<bool> visited(edges_num, false);
+          for (size_t h = 0; h < edges_num; ++h)
+            {
+              if (visited[h] || (n <= h && h < 2 * n))
+                continue;
+              const size_t start = faces.size();
+              size_t e = h;
+              do
+                {
+                  if (visited[e] || (n <= e && e < 2 * n) || faces.size() - start > n)
+                    return false;
+                  visited[e] = true;
+                  faces.push_back(origin[e]);
+                  e = face_next(e);
+                }
+              while (e != h);
+              face_ends.push_back(faces.size());
+            }
+          return true;
+        }
+
+        void add_triangle(std::vector<wide_point_type> const & points,
+                          id_type a, id_type b, id_type c,
+                          std::vector<triangle_type<id_type>> & result)
+        {
+          if (turn(points[a], points[b], points[c]) < 0)
+            std::swap(b, c);
+          result.emplace_back(a, b, c);
+        }
+
+        // linear time triangulation of a y-monotone counter clockwise
+        // polygon, order and stack are scratch buffers
+        bool triangulate_monotone(std::vector<wide_point_type> const & points,
+                                  std::vector<id_type> const & face,
+                                  std::vector<std::pair<size_t, bool>> & order,
+                                  std::vector<size_t> & stack,
+                                  std::vector<triangle_type<id_type>> & result)
+        {
+          const size_t m = face.size();
+          auto at = [&](size_t i) -> wide_point_type const & { return points[face[i]]; };
+          auto forward = [&](size_t i) { return i + 1 == m ? 0 : i + 1; };
+          auto backward = [&](size_t i) { return i == 0 ? m - 1 : i - 1; };
+
+          size_t top = 0, bottom = 0;
+          for (size_t i = 1; i < m; ++i)
+            {
+              if (above(at(i), at(top)))
+                top = i;
+              if (above(at(bottom), at(i)))
+                bottom = i;
+            }
+
+          // merge the chains, the left one runs forward from the top
+          order.clear();
+          order.emplace_back(top, true);
+          size_t l = forward(top), r = backward(top);
+          while (l != bottom || r != bottom)
+            {
+              bool left = r == bottom || (l != bottom && above(at(l), at(r)));
+              size_t & i = left ? l : r;
+              size_t before = left ? backward(i) : forward(i);
+              if (!above(at(before), at(i)))
+                return false;
+              order.emplace_back(i, left);
+              i = left ? forward(i) : backward(i);
+            }
+          order.emplace_back(bottom, true);
+
+          stack.assign({0, 1});
+          for (size_t j = 2; j + 1 < m; ++j)
+            {
+              size_t u = order[j].first;
+              bool left = order[j].second;
+              if (left != order[stack.back()].second)
+                {
+                  for (size_t k = 0; k + 1 < stack.size(); ++k)
+                    add_triangle(points, face[u],
+                                 face[order[stack[k]].first],
+                                 face[order[stack[k + 1]].first], result);
+                  stack.assign({j - 1, j});
+                }
+              else
+                {
+                  size_t a = stack.back();
+                  stack.pop_back();
+                  while (!stack.empty())
+                    {
+                      size_t b = stack.back();
+                      wide_point_type const & pa = at(order[a].first);
+                      wide_point_type const & pb = at(order[b].first);
+                      bool inside = left
+                        ? is_left_turn(pb, pa, at(u))
+                        : is_left_turn(at(u), pa, pb);
+                      if (!inside)
+                        break;
+                      add_triangle(points, face[u], face[order[a].first],
+                                   face[order[b].first], result);
+                      a = b;
+                      stack.pop_back();
+                    }
+                  stack.push_back(a);
+                  stack.push_back(j);
+                }
+            }
+          for (size_t k = 0; k + 1 < stack.size(); ++k)
+            add_triangle(points, face[bottom],
+                         face[order[stack[k]].first],
+                         face[order[stack[k + 1]].first], result);
+          return true;
+        }
+      }
+
+      bool triangulate_star(std::vector<wide_point_type> const & points,
+                            id_type center,
+                            id_type const * poly, size_t size,
+                            std::vector<triangle_type<id_type>> & result)
+      {
+        assert(size >= 3 && size <= MAX_STAR_SIZE);
+        const size_t first = result.size();
+        wide_point_type const & c = points[center];
+        uint8_t prev[MAX_STAR_SIZE], next[MAX_STAR_SIZE];
+        for (size_t i = 0; i < size; ++i)
+          {
+            prev[i] = i == 0 ? size - 1 : i - 1;
+            next[i] = i + 1 == size ? 0 : i + 1;
+          }
+
+        size_t remaining = size, v = 0, stalled = 0;
+        while (remaining > 3)
+          {
+            size_t p = prev[v], q = next[v];
+            // an ear whose diagonal keeps the center inside is empty, every
+            // other vertex lies outside its sector as seen from the center
+            if (is_left_turn(points[poly[p]], points[poly[v]], points[poly[q]])
+                && turn(points[poly[p]], points[poly[q]], c) >= 0)
+              {
+                result.emplace_back(poly[p], poly[v], poly[q]);
+                next[p] = q;
+                prev[q] = p;
+                --remaining;
+                stalled = 0;
+                v = p;
+              }
+            else if (++stalled > remaining)
+              {
+                result.erase(result.begin() + first, result.end());
+                return false;
+              }
+            else
+              v = q;
+          }
+        result.emplace_back(poly[prev[v]], poly[v], poly[next[v]]);
+        return true;
+      }
+
+      namespace
+      {
+        // poly holds the rings one after another, next links each
+        // position to its successor within its ring
+        bool triangulate_rings(std::vector<wide_point_type> const & points,
+                               std::vector<id_type> const & poly,
+                               std::vector<size_t> const & next,
+                               size_t expected,
+                               std::vector<triangle_type<id_type>> & result)
+        {
+          const size_t first = result.size();
+          std::vector<size_t> prev(poly.size());
+          for (size_t i = 0; i < poly.size(); ++i)
+            prev[next[i]] = i;
+
+          std::vector<std::pair<size_t, size_t>> diagonals;
+          std::vector<size_t> faces, face_ends;
+          bool ok = make_monotone(points, poly, next, prev, diagonals)
+            && split_faces(points, poly, next, diagonals, faces, face_ends);
+
+          std::vector<id_type> face;
+          std::vector<std::pair<size_t, bool>> order;
+          std::vector<size_t> stack;
+          for (size_t i = 0, k = 0; ok && i < face_ends.size(); ++i)
+            {
+              face.clear();
+              for (; k < face_ends[i]; ++k)
+                face.push_back(poly[faces[k]]);
+              ok = face.size() >= 3
+                && triangulate_monotone(points, face, order, stack, result);
+            }
+
+          ok = ok && result.size() - first == expected;
+          for (size_t i = first; ok && i < result.size(); ++i)
+            ok = is_left_turn(points[result[i].a], points[result[i].b], points[result[i].c]);
+          if (!ok)
+            result.erase(result.begin() + first, result.end());
+          return ok;
+        }
+      }
+
+      namespace
+      {
+        typedef std::pair<id_type, id_type> segment_type;
+
+        // status of edges_meet_at_ends, as edge_less for segments from
+        // their upper to their lower end
+        struct segment_less
+        {
+          std::vector<wide_point_type> const * points;
+          std::vector<segment_type> const * segments;
+          wide_point_type const * query;
+
+          wide_point_type const & upper(size_t s) const
+          {
+            return (*points)[(*segments)[s].first];
+          }
+
+          wide_point_type const & lower(size_t s) const
+          {
+            return (*points)[(*segments)[s].second];
+          }
+
+          bool operator ()(size_t l, size_t r) const
+          {
+            if (l == r)
+              return false;
+            if (l == QUERY)
+              return turn(upper(r), lower(r), *query) < 0;
+            if (r == QUERY)
+              return turn(upper(l), lower(l), *query) > 0;
+            return west_of(upper(l), lower(l), upper(r), lower(r));
+          }
+        };
+
+        bool on_segment(wide_point_type const & a, wide_point_type const & b,
+                        wide_point_type const & p)
+        {
+          return turn(a, b, p) == 0
+            && std::min(a.x, b.x) <= p.x && p.x <= std::max(a.x, b.x)
+            && std::min(a.y, b.y) <= p.y && p.y <= std::max(a.y, b.y);
+        }
+
+        // whether two distinct segments have a point in common other
+        // than a shared end
+        bool meet(std::vector<wide_point_type> const & points,
+                  segment_type const & l, segment_type const & r)
+        {
+          wide_point_type const & a = points[l.first], & b = points[l.second];
+          wide_point_type const & c = points[r.first], & d = points[r.second];
+          if (l.first == r.first || l.second == r.second)
+            return on_segment(a, b, l.first == r.first ? d : c)
+              || on_segment(c, d, l.first == r.first ? b : a);
+          if (l.first == r.second || l.second == r.first)
+            return on_segment(a, b, l.first == r.second ? c : d)
+              || on_segment(c, d, l.first == r.second ? b : a);
+          if (turn(a, b, c) * turn(a, b, d) < 0 && turn(c, d, a) * turn(c, d, b) < 0)
+            return true;
+          return on_segment(a, b, c) || on_segment(a, b, d)
+            || on_segment(c, d, a) || on_segment(c, d, b);
+        }
+      }
+
+      bool edges_meet_at_ends(std::vector<wide_point_type> const & points,
+                              std::vector<segment_type> edges)
+      {
+        for (auto & e: edges)
+          if (above(points[e.second], points[e.first]))
+            std::swap(e.first, e.second);
+        std::sort(edges.begin(), edges.end());
+        edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+        const size_t m = edges.size();
+
+        // vertices in sweep order; segments start at their upper end, so
+        // the ones starting at v are a range of edges
+        std::vector<id_type> vertices;
+        vertices.reserve(2 * m);
+        std::vector<size_t> ending(m);
+        for (size_t s = 0; s < m; ++s)
+          {
+            vertices.push_back(edges[s].first);
+            vertices.push_back(edges[s].second);
+            ending[s] = s;
+          }
+        auto sweep_less = [&](id_type l, id_type r)
+          {
+            return above(points[l], points[r]) || (points[l] == points[r] && l < r);
+          };
+        std::sort(vertices.begin(), vertices.end(), sweep_less);
+        vertices.erase(std::unique(vertices.begin(), vertices.end()), vertices.end());
+        std::sort(ending.begin(), ending.end(), [&](size_t l, size_t r)
+                  {
+                    return edges[l].second < edges[r].second;
+                  });
+
+        wide_point_type query;
+        structures::monotonic_arena arena;
+        typedef std::set<size_t, segment_less, structures::arena_allocator<size_t>> status_type;
+        status_type status(segment_less{&points, &edges, &query},
+                           structures::arena_allocator<size_t>(&arena));
+        std::vector<status_type::iterator> position(m);
+        auto adjacent_meet = [&](status_type::iterator it)
+          {
+            return it != status.begin() && it != status.end()
+              && meet(points, edges[*std::prev(it)], edges[*it]);
+          };
+
+        for (id_type v: vertices)
+          {
+            // segments v lies on: the ones ending at v, and any other is
+            // touched inside
+            query = points[v];
+            for (auto it = status.lower_bound(QUERY);
+                 it != status.end() && turn(points[edges[*it].first],
+                                            points[edges[*it].second], query) == 0;
+                 ++it)
+              if (edges[*it].second != v)
+                return false;
+
+            auto e = std::lower_bound(ending.begin(), ending.end(), v,
+                                      [&](size_t s, id_type v)
+                                      {
+                                        return edges[s].second < v;
+                                      });
+            for (; e != ending.end() && edges[*e].second == v; ++e)
+              status.erase(position[*e]);
+            if (adjacent_meet(status.lower_bound(QUERY)))
+              return false;
+
+            size_t first = std::lower_bound(edges.begin(), edges.end(),
+                                            segment_type(v, 0)) - edges.begin();
+            size_t last = first;
+            for (; last < m && edges[last].first == v; ++last)
+              {
+                auto inserted = status.insert(last);
+                // collinear with a segment starting at v
+                if (!inserted.second)
+                  return false;
+                position[last] = inserted.first;
+              }
+            for (size_t s = first; s < last; ++s)
+              if (adjacent_meet(position[s]) || adjacent_meet(std::next(position[s])))
+                return false;
+          }
+        return true;
+      }
+
+      bool triangulate_polygon(std::vector<wide_point_type> const & points,
+                               std::vector<id_type> const & poly,
+                               std::vector<triangle_type<id_type>> & result)
+      {
+        assert(poly.size() >= 3);
+        std::vector<size_t> next(poly.size());
+        for (size_t i = 0; i < poly.size(); ++i)
+          next[i] = i + 1 == poly.size() ? 0 : i + 1;
+        return triangulate_rings(points, poly, next, poly.size() - 2, result);
+      }
+
+      bool triangulate_region(std::vector<wide_point_type> const & points,
+                              std::vector<std::vector<id_type>> const & rings,
+                              std::vector<triangle_type<id_type>> & result)
+      {
+        std::vector<id_type> poly;
+        std::vector<size_t> next;
+        // every region with h holes takes n + 2 h - 2 triangles
+        int64_t expected = 0;
+        for (auto const & ring: rings)
+          {
+            assert(ring.size() >= 3);
+            double area = 0;
+            for (size_t i = 0, j = ring.size() - 1; i < ring.size(); j = i++)
+              area += double(points[ring[j]].x) * points[ring[i]].y
+                - double(points[ring[i]].x) * points[ring[j]].y;
+            expected += ring.size() + (area > 0 ? -2 : 2);
+
+            size_t start = poly.size();
+            for (size_t i = 0; i < ring.size(); ++i)
+              {
+                poly.push_back(ring[i]);
+                next.push_back(i + 1 == ring.size() ? start : start + i + 1);
+              }
+          }
+        if (expected <= 0)
+          return false;
+        return triangulate_rings(points, poly, next, expected, result);
+      }
+    }
+  }
+}
@@ -0,0 +1,61 @@
+#ifndef _POLYGON_TRIANGULATION_H
+#define _POLYGON_TRIANGULATION_H
+
+#include "common.h"
+#include "triangle.h"
+#include "wide_point.h"
+
+#include <utility>
+#include <vector>
+
+namespace geom
+{
+  namespace algorithms
+  {
+    namespace triangulation
+    {
+      using geom::structures::wide_point_type;
+      using geom::structures::triangle_type;
+
+      // largest polygon triangulate_star accepts
+      const size_t MAX_STAR_SIZE = 64;
+
+      // Vertices are ids into points, which may include the corners of a
+      // bounding triangle outside the int32 range.
+
+      // Triangulates the counter clockwise polygon poly[0 .. size), which
+      // must be star-shaped with center strictly inside its kernel, in
+      // linear time without allocating. Appends size - 2 counter
+      // clockwise triangles to result, or nothing when poly turns out not
+      // to be star-shaped around center.
+      bool triangulate_star(std::vector<wide_point_type> const & points,
+                            id_type center,
+                            id_type const * poly, size_t size,
+                            std::vector<triangle_type<id_type>> & result);
+
+      // Triangulates a simple counter clockwise polygon in O(n log n) by a
+      // sweep splitting it into y-monotone pieces. Appends poly.size() - 2
+      // counter clockwise triangles to result, or nothing when the sweep
+      // fails on a degenerate polygon.
+      bool triangulate_polygon(std::vector<wide_point_type> const & points,
+                               std::vector<id_type> const & poly,
+                               std::vector<triangle_type<id_type>> & result);
+
+      // Triangulates the region left of the rings by the same sweep:
+      // counter clockwise rings bound it from outside, clockwise ones are
+      // holes, and rings may touch only at vertices. Appends the counter
+      // clockwise triangles to result, or nothing on failure.
+      bool triangulate_region(std::vector<wide_point_type> const & points,
+                              std::vector<std::vector<id_type>> const & rings,
+                              std::vector<triangle_type<id_type>> & result);
+
+      // Whether the edges, pairs of ids into points, have no point in
+      // common but shared ends, by a sweep in O(n log n). Equal edges
+      // count once; the points they reach must be distinct.
+      bool edges_meet_at_ends(std::vector<wide_point_type> const & points,
+                              std::vector<std::pair<id_type, id_type>> edges);
+    }
+  }
+}
+
+#endif // _POLYGON_TRIANGULATION_H
@@ -0,0 +1,60 @@
+#include "predicates.h"
+
+namespace geom
+{
+  namespace predicates
+  {
+    namespace
+    {
+      // error free transformations: x + y equals the exact result
+      void two_sum(double a, double b, double & x, double & y)
+      {
+        x = a + b;
+        double b_virtual = x - a;
+        double a_virtual = x - b_virtual;
+        y = (a - a_virtual) + (b - b_virtual);
+      }
+
+      void two_product(double a, double b, double & x, double & y)
+      {
+        x = a * b;
+        y = std::fma(a, b, -x);
+      }
+
+      // adds b to the nonoverlapping expansion e[0 .. size), ordered by
+      // increasing magnitude; e must have room for one more component
+      size_t grow_expansion(double * e, size_t size, double b)
+      {
+        double q = b;
+        for (size_t i = 0; i < size; ++i)
+          two_sum(q, e[i], q, e[i]);
+        e[size] = q;
+        return size + 1;
+      }
+    }
+
+    int orientation_exact(double ax, double ay,
+                          double bx, double by,
+                          double cx, double cy)
+    {
+      // bx cy - bx ay - ax cy - by cx + by ax + ay cx
+      double const factors[6][2] = {{bx, cy}, {-bx, ay}, {-ax, cy},
+                                    {-by, cx}, {by, ax}, {ay, cx}};
+      double e[12];
+      size_t size = 0;
+      for (auto const & f: factors)
+        {
+          double x, y;
+          two_product(f[0], f[1], x, y);
+          size = grow_expansion(e, size, y);
+          size = grow_expansion(e, size, x);
+        }
+      // the largest nonzero component carries the sign
+      while (size != 0 && e[size - 1] == 0)
+        --size;
+      if (size == 0)
+        return 0;
+      return e[size - 1] > 0 ? 1 : -1;
+    }
+  }
+}
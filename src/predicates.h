@@ -0,0 +1,86 @@
+#ifndef _PREDICATES_H
+#define _PREDICATES_H
+
+#include <cmath>
+#include <cstdlib>
+
+#include "common.h"
+#include "determinant.h"
+
+namespace geom
+{
+  namespace predicates
+  {
+    __extension__ typedef __int128 int128_t;
+
+    // Sign of the turn a -> b -> c: positive for a left turn, zero when
+    // the points are collinear. Exact for every supported coordinate type.
+    template <typename T>
+    int orientation(T ax, T ay, T bx, T by, T cx, T cy);
+
+    // Differences of int32_t coordinates take 33 bits. Below 2^31 the
+    // int64_t det2 is exact, wider ones go to 128 bits.
+    template <>
+    inline int orientation<int32_t>(int32_t ax, int32_t ay,
+                                    int32_t bx, int32_t by,
+                                    int32_t cx, int32_t cy)
+    {
+      int64_t abx = int64_t(bx) - ax, aby = int64_t(by) - ay;
+      int64_t acx = int64_t(cx) - ax, acy = int64_t(cy) - ay;
+      const uint64_t bound = uint64_t(1) << 31;
+      if (uint64_t(abx) + bound < 2 * bound && uint64_t(aby) + bound < 2 * bound
+          && uint64_t(acx) + bound < 2 * bound && uint64_t(acy) + bound < 2 * bound)
+        {
+          int64_t d = det2(abx, aby, acx, acy);
+          return (d > 0) - (d < 0);
+        }
+      int128_t d = int128_t(abx) * acy - int128_t(aby) * acx;
+      return (d > 0) - (d < 0);
+    }
+
+    // int64_t coordinates must stay within +-2^62, so that the
+    // differences fit in int64_t and their products in 128 bits. Short
+    // differences take the int64_t det2 as for int32_t.
+    template <>
+    inline int orientation<int64_t>(int64_t ax, int64_t ay,
+                                    int64_t bx, int64_t by,
+                                    int64_t cx, int64_t cy)
+    {
+      int64_t abx = bx - ax, aby = by - ay;
+      int64_t acx = cx - ax, acy = cy - ay;
+      const uint64_t bound = uint64_t(1) << 31;
+      if (uint64_t(abx) + bound < 2 * bound && uint64_t(aby) + bound < 2 * bound
+          && uint64_t(acx) + bound < 2 * bound && uint64_t(acy) + bound < 2 * bound)
+        {
+          int64_t d = det2(abx, aby, acx, acy);
+          return (d > 0) - (d < 0);
+        }
+      int128_t d = int128_t(abx) * acy - int128_t(aby) * acx;
+      return (d > 0) - (d < 0);
+    }
+
+    // exact sign of the determinant, used when the filter fails
+    int orientation_exact(double ax, double ay,
+                          double bx, double by,
+                          double cx, double cy);
+
+    // Floating point evaluation filtered by a static relative error
+    // bound, only nearly degenerate triples pay for exact arithmetic.
+    template <>
+    inline int orientation<double>(double ax, double ay,
+                                   double bx, double by,
+                                   double cx, double cy)
+    {
+      // (3 + 16 eps) eps for eps = 2^-53
+      const double error_bound = 3.3306690738754716e-16;
+      double left = (ax - cx) * (by - cy);
+      double right = (ay - cy) * (bx - cx);
+      double d = left - right;
+      if (std::fabs(d) > error_bound * (std::fabs(left) + std::fabs(right)))
+        return (d > 0) - (d < 0);
+      return orientation_exact(ax, ay, bx, by, cx, cy);
+    }
+  }
+}
+
+#endif // _PREDICATES_H
@@ -0,0 +1,234 @@
+#include "query_executor.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <thread>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace geom
+{
+  namespace algorithms
+  {
+    namespace localization
+    {
+      namespace
+      {
+        typedef std::chrono::steady_clock clock_type;
+
+        // numbers in a sysfs list like "0-3,8,10-11"
+        std::vector<int> parse_list(std::string const & list)
+        {
+          std::vector<int> result;
+          int first = -1, value = -1;
+          for (size_t i = 0; i <= list.size(); ++i)
+            {
+              char c = i < list.size() ? list[i] : ',';
+              if (c >= '0' && c <= '9')
+                value = (value < 0 ? 0 : 10 * value) + (c - '0');
+              else if (c == '-')
+                {
+                  first = value;
+                  value = -1;
+                }
+              else if (value >= 0)
+                {
+                  for (int k = first < 0 ? value : first; k <= value; ++k)
+                    result.push_back(k);
+                  first = value = -1;
+                }
+            }
+          return result;
+        }
+
+        std::string read_line(std::string const & path)
+        {
+          std::ifstream in(path);
+          std::string line;
+          std::getline(in, line);
+          return line;
+        }
+
+        // cpus of every online numa node with any, none when unknown
+        std::vector<std::vector<int>> numa_cpus()
+        {
+          std::vector<std::vector<int>> result;
+          const std::string root = "/sys/devices/system/node/";
+          for (int node: parse_list(read_line(root + "online")))
+            {
+              std::vector<int> cpus =
+                parse_list(read_line(root + "node" + std::to_string(node) + "/cpulist"));
+              if (!cpus.empty())
+                result.push_back(cpus);
+            }
+          return result;
+        }
+
+        // best effort, the workers run anywhere when it fails
+        void pin(std::vector<int> const & cpus)
+        {
+#ifdef __linux__
+          cpu_set_t set;
+          CPU_ZERO(&set);
+          for (int cpu: cpus)
+            if (cpu < CPU_SETSIZE)
+              CPU_SET(cpu, &set);
+          pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+          (void)cpus;
+#endif
+        }
+
+        int current_cpu()
+        {
+#ifdef __linux__
+          return sched_getcpu();
+#else
+          return -1;
+#endif
+        }
+      }
+
+      struct query_executor::node_type
+      {
+        std::vector<int> cpus;
+        std::unique_ptr<query_layout> layout;
+        // workers on the node in the current batch
+        size_t workers = 0;
+      };
+
+      query_executor::query_executor(kirkpatrick_refinement const & refinement,
+                                     executor_options const & options)
+        : refinement_(refinement)
+        , options_(options)
+        , pool_(options.threads ? options.threads
+                : std::max<size_t>(1, std::thread::hardware_concurrency()))
+        , workers_(pool_.size())
+      {
+        options_.grain = (std::max<size_t>(options_.grain, 1) + 15) / 16 * 16;
+
+        std::vector<std::vector<int>> cpus;
+        if (options_.numa)
+          cpus = numa_cpus();
+        if (cpus.empty())
+          cpus.resize(1);
+        for (auto & node_cpus: cpus)
+          {
+            nodes_.emplace_back(new node_type());
+            nodes_.back()->cpus = std::move(node_cpus);
+          }
+        shards_.reset(new shard_type[nodes_.size()]);
+
+        // each copy made by a thread on its node, so its pages are local
+        if (options_.numa && options_.replicate)
+          for (auto & node: nodes_)
+            {
+              node_type * target = node.get();
+              std::thread([this, target]
+                          {
+                            pin(target->cpus);
+                            target->layout.reset(new query_layout(refinement_.layout()));
+                          }).join();
+            }
+      }
+
+      query_executor::~query_executor() {}
+
+      void query_executor::find_queries(point_type const * points, size_t count,
+                                        id_type * result)
+      {
+        if (count == 0)
+          return;
+
+        for (auto & node: nodes_)
+          node->workers = 0;
+        for (size_t worker = 0; worker < workers_.size(); ++worker)
+          {
+            workers_[worker].report = worker_report();
+            workers_[worker].report.node = node_of(worker);
+            ++nodes_[workers_[worker].report.node]->workers;
+          }
+
+        // shards of whole chunks, by the workers of every node
+        const size_t grain = options_.grain;
+        const size_t chunks = (count + grain - 1) / grain;
+        size_t first_chunk = 0;
+        for (size_t n = 0; n < nodes_.size(); ++n)
+          {
+            size_t last_chunk = n + 1 == nodes_.size() ? chunks
+              : first_chunk + chunks * nodes_[n]->workers / workers_.size();
+            shards_[n].next = first_chunk * grain;
+            shards_[n].end = std::min(last_chunk * grain, count);
+            first_chunk = last_chunk;
+          }
+
+        pool_.parallel_for(pool_.size(), 1, [&](size_t, size_t, size_t worker)
+                           {
+                             work(worker, points, result);
+                           });
+      }
+
+      std::vector<query_executor::worker_report> query_executor::report() const
+      {
+        std::vector<worker_report> result;
+        for (worker_slot const & slot: workers_)
+          result.push_back(slot.report);
+        return result;
+      }
+
+      void query_executor::work(size_t worker, point_type const * points, id_type * result)
+      {
+        worker_slot & slot = workers_[worker];
+        const size_t node = slot.report.node;
+        if (worker != 0 && nodes_.size() > 1 && !slot.pinned)
+          {
+            pin(nodes_[node]->cpus);
+            slot.pinned = true;
+          }
+        query_layout const & layout = nodes_[node]->layout ? *nodes_[node]->layout
+          : refinement_.layout();
+        clock_type::time_point start = clock_type::now();
+        double before = slot.report.seconds;
+
+        // the own shard first, then the others in turn
+        for (size_t k = 0; k < nodes_.size(); ++k)
+          {
+            shard_type & shard = shards_[(node + k) % nodes_.size()];
+            while (true)
+              {
+                size_t begin = shard.next.fetch_add(options_.grain);
+                if (begin >= shard.end)
+                  break;
+                size_t end = std::min(begin + options_.grain, shard.end);
+                layout.locate(points + begin, end - begin, result + begin);
+                slot.report.queries += end - begin;
+                ++slot.report.chunks;
+                slot.report.stolen += k != 0;
+              }
+          }
+        slot.report.seconds = before
+          + std::chrono::duration<double>(clock_type::now() - start).count();
+      }
+
+      size_t query_executor::node_of(size_t worker) const
+      {
+        if (nodes_.size() == 1)
+          return 0;
+        if (worker != 0)
+          return (worker - 1) % nodes_.size();
+        // the calling thread stays where it is
+        int cpu = current_cpu();
+        for (size_t n = 0; n < nodes_.size(); ++n)
+          if (std::find(nodes_[n]->cpus.begin(), nodes_[n]->cpus.end(), cpu)
+              != nodes_[n]->cpus.end())
+            return n;
+        return 0;
+      }
+    }
+  }
+}
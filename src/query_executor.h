@@ -0,0 +1,116 @@
+#ifndef _QUERY_EXECUTOR_H
+#define _QUERY_EXECUTOR_H
+
+#include "kirkpatrick_refinement.h"
+#include "query_layout.h"
+#include "thread_pool.h"
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace geom
+{
+  namespace algorithms
+  {
+    namespace localization
+    {
+      struct executor_options
+      {
+        // workers including the calling thread, 0 for one per cpu
+        size_t threads = 0;
+        // queries per chunk, rounded up to a multiple of 16, so chunks
+        // of the result share no cache line when it is 64 byte aligned
+        size_t grain = 4096;
+        // Pins every worker but the calling thread to a numa node, round
+        // robin, and gives each node a shard of the queries, taken by
+        // its workers first and stolen by the others when they run out.
+        bool numa = false;
+        // with numa, answers from a copy of the query layout per node,
+        // made on that node
+        bool replicate = false;
+      };
+
+      // Runs large batches of queries over a kirkpatrick_refinement on a
+      // pool of workers, each chunk located like find_queries. The
+      // refinement must outlive the executor and stay unchanged. One
+      // batch runs at a time.
+      struct query_executor
+      {
+        typedef kirkpatrick_refinement::id_type id_type;
+
+        // what a worker did in the last batch
+        struct worker_report
+        {
+          size_t node = 0;
+          size_t queries = 0;
+          size_t chunks = 0;
+          // chunks taken from the shard of another node
+          size_t stolen = 0;
+          // spent taking and locating chunks
+          double seconds = 0;
+        };
+
+        explicit query_executor(kirkpatrick_refinement const & refinement,
+                                executor_options const & options = executor_options());
+        ~query_executor();
+
+        query_executor(query_executor const &) = delete;
+        query_executor & operator =(query_executor const &) = delete;
+
+        // result[i] as refinement.find_query(points[i])
+        void find_queries(point_type const * points, size_t count, id_type * result);
+
+        size_t threads_num() const
+        {
+          return pool_.size();
+        }
+
+        // numa nodes the workers are spread over, 1 without numa
+        size_t nodes_num() const
+        {
+          return nodes_.size();
+        }
+
+        // by worker, worker 0 is the calling thread
+        std::vector<worker_report> report() const;
+
+      private:
+        struct node_type;
+
+        // padded to two cache lines, whatever the alignment of the
+        // vector holding them
+        struct worker_slot
+        {
+          worker_report report;
+          bool pinned = false;
+          char padding[128 - sizeof(worker_report) - sizeof(bool)];
+        };
+
+        struct shard_type
+        {
+          std::atomic<size_t> next;
+          size_t end = 0;
+          char padding[128 - sizeof(std::atomic<size_t>) - sizeof(size_t)];
+        };
+
+        // runs chunks as worker until no shard has any left, pins the
+        // worker to its node first
+        void work(size_t worker, point_type const * points, id_type * result);
+
+        // node of worker, the node of the current cpu for worker 0
+        size_t node_of(size_t worker) const;
+
+      private:
+        kirkpatrick_refinement const & refinement_;
+        executor_options options_;
+        thread_pool pool_;
+        std::vector<std::unique_ptr<node_type>> nodes_;
+        std::vector<worker_slot> workers_;
+        std::unique_ptr<shard_type[]> shards_;
+      };
+    }
+  }
+}
+
+#endif // _QUERY_EXECUTOR_H
@@ -0,0 +1,441 @@
+#include "query_layout.h"
+
+#include <algorithm>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+#include <utility>
+
+namespace geom
+{
+  namespace algorithms
+  {
+    namespace localization
+    {
+      query_layout::query_layout(std::vector<wide_point_type> const & points,
+                                 search_dag_type const & dag)
+      {
+        vectors_type & vectors = data_.vectors;
+        const size_t n = dag.vertices.size();
+        auto children = [&](id_type id) -> search_dag_type::edges_type const &
+        {
+          static const search_dag_type::edges_type none;
+          return id < dag.edges.size() ? dag.edges[id] : none;
+        };
+
+        // breadth-first renumbering
+        const id_type unvisited = std::numeric_limits<id_type>::max();
+        vectors.nodes.assign(n, unvisited);
+        vectors.original_ids.reserve(n);
+        vectors.original_ids.push_back(0);
+        vectors.nodes[0] = 0;
+        for (size_t k = 0; k < vectors.original_ids.size(); ++k)
+          for (id_type child: children(vectors.original_ids[k]))
+            if (vectors.nodes[child] == unvisited)
+              {
+                vectors.nodes[child] = vectors.original_ids.size();
+                vectors.original_ids.push_back(child);
+              }
+
+        auto x_range = std::minmax_element(points.begin(), points.end(),
+                                           [](wide_point_type const & l,
+                                              wide_point_type const & r)
+                                           {
+                                             return l.x < r.x;
+                                           });
+        auto y_range = std::minmax_element(points.begin(), points.end(),
+                                           [](wide_point_type const & l,
+                                              wide_point_type const & r)
+                                           {
+                                             return l.y < r.y;
+                                           });
+        const int64_t max_span = std::numeric_limits<int32_t>::max();
+        const int64_t min_coordinate = std::numeric_limits<int32_t>::min();
+        bool narrow = x_range.second->x - x_range.first->x <= max_span
+          && y_range.second->y - y_range.first->y <= max_span
+          && x_range.first->x >= min_coordinate && x_range.second->x <= max_span
+          && y_range.first->y >= min_coordinate && y_range.second->y <= max_span;
+        kernel_ = best_find_child_kernel();
+
+        auto const & root = dag.vertices[0];
+        data_.root[0] = points[root.a];
+        data_.root[1] = points[root.b];
+        data_.root[2] = points[root.c];
+
+        vectors.offsets.reserve(vectors.original_ids.size() + 1);
+        for (id_type original: vectors.original_ids)
+          {
+            vectors.offsets.push_back(vectors.blocks.size());
+            auto const & ids = children(original);
+            for (size_t i = 0; i < ids.size(); ++i)
+              {
+                if (i % child_block::WIDTH == 0)
+                  {
+                    vectors.blocks.push_back(child_block());
+                    if (!narrow)
+                      vectors.wide_blocks.push_back(wide_block());
+                  }
+                child_block & block = vectors.blocks.back();
+                uint32_t lane = block.size++;
+                auto const & t = dag.vertices[ids[i]];
+                wide_point_type const & a = points[t.a];
+                wide_point_type const & b = points[t.b];
+                wide_point_type const & c = points[t.c];
+                if (!narrow)
+                  {
+                    wide_block & wide = vectors.wide_blocks.back();
+                    wide.ax[lane] = a.x;  wide.ay[lane] = a.y;
+                    wide.bx[lane] = b.x;  wide.by[lane] = b.y;
+                    wide.cx[lane] = c.x;  wide.cy[lane] = c.y;
+                  }
+                // coordinates and edge vectors wrap when !narrow, they
+                // are unused then
+                block.ax[lane] = a.x;  block.ay[lane] = a.y;
+                block.bx[lane] = b.x;  block.by[lane] = b.y;
+                block.cx[lane] = c.x;  block.cy[lane] = c.y;
+                block.abx[lane] = uint32_t(b.x) - uint32_t(a.x);
+                block.aby[lane] = uint32_t(b.y) - uint32_t(a.y);
+                block.bcx[lane] = uint32_t(c.x) - uint32_t(b.x);
+                block.bcy[lane] = uint32_t(c.y) - uint32_t(b.y);
+                block.cax[lane] = uint32_t(a.x) - uint32_t(c.x);
+                block.cay[lane] = uint32_t(a.y) - uint32_t(c.y);
+                block.id[lane] = vectors.nodes[ids[i]];
+              }
+          }
+        vectors.offsets.push_back(vectors.blocks.size());
+        data_.owned = true;
+        data_.bind();
+      }
+
+      query_layout::query_layout(arrays const & data)
+        : data_(data)
+        , kernel_(best_find_child_kernel())
+      {}
+
+      query_layout::storage_type::storage_type(storage_type const & other)
+        : arrays(other)
+        , owned(other.owned)
+        , vectors(other.vectors)
+      {
+        if (owned)
+          bind();
+      }
+
+      query_layout::storage_type &
+      query_layout::storage_type::operator =(storage_type const & other)
+      {
+        if (this != &other)
+          *this = storage_type(other);
+        return *this;
+      }
+
+      query_layout::storage_type::storage_type(storage_type && other)
+        : arrays(other)
+        , owned(other.owned)
+        , vectors(std::move(other.vectors))
+      {
+        if (owned)
+          bind();
+        static_cast<arrays &>(other) = arrays();
+        other.owned = false;
+      }
+
+      query_layout::storage_type &
+      query_layout::storage_type::operator =(storage_type && other)
+      {
+        if (this != &other)
+          {
+            static_cast<arrays &>(*this) = other;
+            owned = other.owned;
+            vectors = std::move(other.vectors);
+            if (owned)
+              bind();
+            static_cast<arrays &>(other) = arrays();
+            other.owned = false;
+          }
+        return *this;
+      }
+
+      void query_layout::storage_type::bind()
+      {
+        blocks = vectors.blocks.data();
+        blocks_num = vectors.blocks.size();
+        wide_blocks = vectors.wide_blocks.empty() ? nullptr : vectors.wide_blocks.data();
+        offsets = vectors.offsets.data();
+        original_ids = vectors.original_ids.data();
+        nodes_num = vectors.original_ids.size();
+        nodes = vectors.nodes.data();
+        triangles_num = vectors.nodes.size();
+      }
+
+      id_type query_layout::step(point_type const & point, id_type node) const
+      {
+        id_type result = node;
+        find_child(data_.blocks + data_.offsets[node],
+                   data_.blocks + data_.offsets[node + 1],
+                   point, false, result);
+        return result;
+      }
+
+      id_type query_layout::descend(point_type const & point, uint8_t const * stop) const
+      {
+        id_type node = start_node(point), child;
+        while (!stop[node]
+               && find_child(data_.blocks + data_.offsets[node],
+                             data_.blocks + data_.offsets[node + 1],
+                             point, true, child))
+          node = child;
+        return node;
+      }
+
+      void query_layout::descend(point_type const * points, size_t count,
+                                 uint8_t const * stop, id_type * result) const
+      {
+        child_block const * blocks = data_.blocks;
+        uint32_t const * offsets = data_.offsets;
+        descend_interleaved(count,
+                            [&](size_t i)
+                            {
+                              result[i] = start_node(points[i]);
+                              return true;
+                            },
+                            [&](size_t i)
+                            {
+                              id_type from = result[i];
+                              if (stop[from]
+                                  || !find_child(blocks + offsets[from],
+                                                 blocks + offsets[from + 1],
+                                                 points[i], true, result[i]))
+                                return false;
+                              __builtin_prefetch(blocks + offsets[result[i]]);
+                              return true;
+                            },
+                            [](size_t, size_t) {});
+      }
+
+      size_t query_layout::children_num(id_type node) const
+      {
+        size_t result = 0;
+        for (uint32_t b = data_.offsets[node]; b != data_.offsets[node + 1]; ++b)
+          result += data_.blocks[b].size;
+        return result;
+      }
+
+      size_t query_layout::rank(id_type node, id_type child) const
+      {
+        size_t result = 0;
+        for (uint32_t b = data_.offsets[node]; b != data_.offsets[node + 1]; ++b)
+          for (uint32_t i = 0; i < data_.blocks[b].size; ++i, ++result)
+            if (data_.blocks[b].id[i] == child)
+              return result;
+        return result;
+      }
+
+      void query_layout::locate(point_type const * points, size_t count,
+                                id_type * result) const
+      {
+        triangle_type<wide_point_type> root(data_.root[0], data_.root[1], data_.root[2]);
+        child_block const * blocks = data_.blocks;
+        uint32_t const * offsets = data_.offsets;
+        // node numbers in result until a group is done
+        descend_interleaved(count,
+                            [&](size_t i)
+                            {
+                              result[i] = 0;
+                              // the packed kernels need the point inside the
+                              // bounding box
+                              if (!root.contains(points[i]))
+                                return false;
+                              result[i] = start_node(points[i]);
+                              return true;
+                            },
+                            [&](size_t i)
+                            {
+                              id_type from = result[i];
+                              if (!find_child(blocks + offsets[from],
+                                              blocks + offsets[from + 1],
+                                              points[i], true, result[i]))
+                                return false;
+                              __builtin_prefetch(blocks + offsets[result[i]]);
+                              return true;
+                            },
+                            [&](size_t first, size_t last)
+                            {
+                              for (size_t i = first; i < last; ++i)
+                                result[i] = data_.original_ids[result[i]];
+                            });
+      }
+
+      void query_layout::order_children(point_type const * queries, size_t count)
+      {
+        if (!data_.owned)
+          throw std::logic_error("query_layout: cannot reorder borrowed arrays");
+        vectors_type & vectors = data_.vectors;
+
+        // lane k of block b is child WIDTH * b + k
+        const uint32_t WIDTH = child_block::WIDTH;
+        std::vector<uint32_t> hits(vectors.blocks.size() * WIDTH, 0);
+        triangle_type<wide_point_type> root(data_.root[0], data_.root[1], data_.root[2]);
+        for (size_t q = 0; q < count; ++q)
+          {
+            if (!root.contains(queries[q]))
+              continue;
+            id_type node = 0, child;
+            while (find_child(data_.blocks + data_.offsets[node],
+                              data_.blocks + data_.offsets[node + 1],
+                              queries[q], true, child))
+              {
+                ++hits[WIDTH * data_.offsets[node] + rank(node, child)];
+                node = child;
+              }
+          }
+
+        // only the last block of a node is partial, so its children are
+        // the lanes [WIDTH * offsets[node], + children_num(node))
+        std::vector<uint32_t> order;
+        std::vector<child_block> old_blocks;
+        std::vector<wide_block> old_wide_blocks;
+        for (id_type node = 0; node < data_.nodes_num; ++node)
+          {
+            uint32_t first = vectors.offsets[node], last = vectors.offsets[node + 1];
+            if (first == last)
+              continue;
+            order.resize(children_num(node));
+            std::iota(order.begin(), order.end(), 0);
+            uint32_t const * weights = hits.data() + WIDTH * first;
+            // positions break ties, keeping the old order
+            std::sort(order.begin(), order.end(),
+                      [weights](uint32_t l, uint32_t r)
+                      {
+                        return weights[l] != weights[r] ? weights[l] > weights[r] : l < r;
+                      });
+            old_blocks.assign(vectors.blocks.begin() + first, vectors.blocks.begin() + last);
+            if (!vectors.wide_blocks.empty())
+              old_wide_blocks.assign(vectors.wide_blocks.begin() + first,
+                                     vectors.wide_blocks.begin() + last);
+            for (uint32_t i = 0; i < order.size(); ++i)
+              {
+                child_block const & from = old_blocks[order[i] / WIDTH];
+                child_block & to = vectors.blocks[first + i / WIDTH];
+                uint32_t j = order[i] % WIDTH, k = i % WIDTH;
+                to.ax[k] = from.ax[j];  to.ay[k] = from.ay[j];
+                to.bx[k] = from.bx[j];  to.by[k] = from.by[j];
+                to.cx[k] = from.cx[j];  to.cy[k] = from.cy[j];
+                to.abx[k] = from.abx[j];  to.aby[k] = from.aby[j];
+                to.bcx[k] = from.bcx[j];  to.bcy[k] = from.bcy[j];
+                to.cax[k] = from.cax[j];  to.cay[k] = from.cay[j];
+                to.id[k] = from.id[j];
+                if (!vectors.wide_blocks.empty())
+                  {
+                    wide_block const & wide_from = old_wide_blocks[order[i] / WIDTH];
+                    wide_block & wide_to = vectors.wide_blocks[first + i / WIDTH];
+                    wide_to.ax[k] = wide_from.ax[j];  wide_to.ay[k] = wide_from.ay[j];
+                    wide_to.bx[k] = wide_from.bx[j];  wide_to.by[k] = wide_from.by[j];
+                    wide_to.cx[k] = wide_from.cx[j];  wide_to.cy[k] = wide_from.cy[j];
+                  }
+              }
+          }
+      }
+
+      size_t query_layout::memory_usage() const
+      {
+        vectors_type const & vectors = data_.vectors;
+        return vectors.blocks.capacity() * sizeof(child_block)
+          + vectors.wide_blocks.capacity() * sizeof(wide_block)
+          + vectors.offsets.capacity() * sizeof(uint32_t)
+          + vectors.original_ids.capacity() * sizeof(id_type)
+          + vectors.nodes.capacity() * sizeof(id_type)
+          + grid_.cells.capacity() * sizeof(id_type);
+      }
+
+      void query_layout::build_grid(size_t memory_budget)
+      {
+        grid_ = grid_type();
+        size_t budget = memory_budget / sizeof(id_type);
+        if (budget == 0 || data_.nodes_num == 0)
+          return;
+
+        wide_point_type const * root = data_.root;
+        int64_t max_x = root[0].x, max_y = root[0].y;
+        grid_.min_x = max_x;
+        grid_.min_y = max_y;
+        for (size_t k = 1; k < 3; ++k)
+          {
+            grid_.min_x = std::min<int64_t>(grid_.min_x, root[k].x);
+            grid_.min_y = std::min<int64_t>(grid_.min_y, root[k].y);
+            max_x = std::max<int64_t>(max_x, root[k].x);
+            max_y = std::max<int64_t>(max_y, root[k].y);
+          }
+        size_grid(max_x - grid_.min_x, max_y - grid_.min_y, budget,
+                  grid_.shift, grid_.columns, grid_.rows);
+        grid_.cells.assign(grid_.columns * grid_.rows, 0);
+        fill_grid(0, grid_.columns, 0, grid_.rows, 0);
+      }
+
+      void query_layout::fill_grid(size_t i0, size_t i1, size_t j0, size_t j1,
+                                   id_type node)
+      {
+        // the corners of the cells, no query point is outside them or
+        // the int32 range
+        const int64_t low = std::numeric_limits<int32_t>::min();
+        const int64_t high = std::numeric_limits<int32_t>::max();
+        int64_t x0 = std::max<int64_t>(grid_.min_x + (int64_t(i0) << grid_.shift), low);
+        int64_t y0 = std::max<int64_t>(grid_.min_y + (int64_t(j0) << grid_.shift), low);
+        int64_t x1 = std::min<int64_t>(grid_.min_x + (int64_t(i1) << grid_.shift) - 1, high);
+        int64_t y1 = std::min<int64_t>(grid_.min_y + (int64_t(j1) << grid_.shift) - 1, high);
+        point_type corners[] = {point_type(x0, y0), point_type(x1, y0),
+                                point_type(x1, y1), point_type(x0, y1)};
+
+        // descends while one child contains the whole rectangle, unless
+        // no query can fall in it
+        bool deeper = x0 <= x1 && y0 <= y1;
+        while (deeper)
+          {
+            deeper = false;
+            for (uint32_t b = data_.offsets[node]; !deeper && b != data_.offsets[node + 1]; ++b)
+              {
+                child_block const & block = data_.blocks[b];
+                for (uint32_t k = 0; !deeper && k < block.size; ++k)
+                  {
+                    triangle_type<wide_point_type> t(wide_point_type(block.ax[k], block.ay[k]),
+                                                     wide_point_type(block.bx[k], block.by[k]),
+                                                     wide_point_type(block.cx[k], block.cy[k]));
+                    if (data_.wide_blocks)
+                      {
+                        wide_block const & wide = data_.wide_blocks[b];
+                        t = triangle_type<wide_point_type>(wide_point_type(wide.ax[k], wide.ay[k]),
+                                                           wide_point_type(wide.bx[k], wide.by[k]),
+                                                           wide_point_type(wide.cx[k], wide.cy[k]));
+                      }
+                    if (t.contains(corners[0]) && t.contains(corners[1])
+                        && t.contains(corners[2]) && t.contains(corners[3]))
+                      {
+                        node = block.id[k];
+                        deeper = true;
+                      }
+                  }
+              }
+          }
+
+        if (is_leaf(node) || (i1 - i0 == 1 && j1 - j0 == 1) || x0 > x1 || y0 > y1)
+          {
+            for (size_t j = j0; j < j1; ++j)
+              std::fill(grid_.cells.begin() + j * grid_.columns + i0,
+                        grid_.cells.begin() + j * grid_.columns + i1, node);
+            return;
+          }
+        // halves the longer side
+        if (i1 - i0 >= j1 - j0)
+          {
+            fill_grid(i0, (i0 + i1) / 2, j0, j1, node);
+            fill_grid((i0 + i1) / 2, i1, j0, j1, node);
+          }
+        else
+          {
+            fill_grid(i0, i1, j0, (j0 + j1) / 2, node);
+            fill_grid(i0, i1, (j0 + j1) / 2, j1, node);
+          }
+      }
+    }
+  }
+}
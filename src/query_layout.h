@@ -0,0 +1,255 @@
+#ifndef _QUERY_LAYOUT_H
+#define _QUERY_LAYOUT_H
+
+#include "arena.h"
+#include "graph.h"
+#include "triangle.h"
+#include "turn_kernels.h"
+#include "query_stats.h"
+
+#include <vector>
+
+namespace geom
+{
+  namespace algorithms
+  {
+    namespace localization
+    {
+      using geom::structures::point_type;
+      using geom::structures::wide_point_type;
+      using geom::structures::graph_type;
+      using geom::structures::triangle_type;
+
+      // search dag whose edge lists live in an arena of its owner
+      typedef graph_type<triangle_type<id_type>,
+                         geom::structures::arena_allocator<id_type>> search_dag_type;
+
+      // Frozen copy of a search dag for queries. Nodes are renumbered in
+      // breadth-first order from the root, so every level is contiguous,
+      // and the children of node k are the blocks
+      // blocks_[offsets_[k] .. offsets_[k + 1]) holding the child
+      // coordinates inline and the children's node numbers.
+      struct query_layout
+      {
+        // the arrays a layout is made of, owned or borrowed
+        struct arrays
+        {
+          child_block const * blocks = nullptr;
+          size_t blocks_num = 0;
+          // nodes_num + 1 entries
+          uint32_t const * offsets = nullptr;
+          id_type const * original_ids = nullptr;
+          size_t nodes_num = 0;
+          // node number of every original triangle id
+          id_type const * nodes = nullptr;
+          size_t triangles_num = 0;
+          wide_point_type root[3];
+          // one per block when coordinates or their differences leave
+          // int32_t, null when the packed kernels are exact
+          wide_block const * wide_blocks = nullptr;
+        };
+
+        query_layout() {}
+        query_layout(std::vector<wide_point_type> const & points,
+                     search_dag_type const & dag);
+        // borrows the arrays, which must outlive the layout
+        explicit query_layout(arrays const & data);
+
+        query_layout(query_layout const & other) = default;
+        query_layout & operator =(query_layout const & other) = default;
+        query_layout(query_layout && other) = default;
+        query_layout & operator =(query_layout && other) = default;
+
+        // original triangle id of the deepest triangle containing point
+        id_type locate(point_type const & point) const
+        {
+          no_stats stats;
+          return locate(point, stats);
+        }
+
+        template <typename Stats>
+        id_type locate(point_type const & point, Stats & stats) const;
+
+        void locate(point_type const * points, size_t count,
+                    id_type * result) const;
+
+        // Node where the descent towards point, which must lie in the
+        // root, stops: the first with stop[node] set, or a leaf.
+        id_type descend(point_type const & point, uint8_t const * stop) const;
+        // descends count points at once, like the batch locate
+        void descend(point_type const * points, size_t count, uint8_t const * stop,
+                     id_type * result) const;
+
+        // one step from a node, returns node itself when no child contains point
+        id_type step(point_type const & point, id_type node) const;
+
+        bool is_leaf(id_type node) const
+        {
+          return data_.offsets[node] == data_.offsets[node + 1];
+        }
+
+        size_t nodes_num() const
+        {
+          return data_.nodes_num;
+        }
+
+        id_type original_id(id_type node) const
+        {
+          return data_.original_ids[node];
+        }
+
+        id_type node_of(id_type original) const
+        {
+          return data_.nodes[original];
+        }
+
+        arrays const & data() const
+        {
+          return data_;
+        }
+
+        size_t children_num(id_type node) const;
+
+        // calls f with the node number of every child of node in order
+        template <typename F>
+        void for_each_child(id_type node, F f) const
+        {
+          for (uint32_t b = data_.offsets[node]; b != data_.offsets[node + 1]; ++b)
+            for (uint32_t i = 0; i < data_.blocks[b].size; ++i)
+              f(data_.blocks[b].id[i]);
+        }
+
+        // Sorts the children of every node by how many of queries descend
+        // to them from it, stably, so the most likely child is tested
+        // first. Node numbers do not change. Throws std::logic_error on
+        // borrowed arrays.
+        void order_children(point_type const * queries, size_t count);
+
+        // Grid of at most memory_budget bytes over the bounding box of
+        // the root. Each cell keeps the deepest node containing all of
+        // it, where queries in the cell start; cells inside a leaf answer
+        // at once. A budget of 0 drops the grid.
+        void build_grid(size_t memory_budget);
+
+        bool has_grid() const
+        {
+          return !grid_.cells.empty();
+        }
+
+        // node a query for point, inside the root, starts from
+        id_type start_node(point_type const & point) const
+        {
+          if (grid_.cells.empty())
+            return 0;
+          size_t i = size_t(int64_t(point.x) - grid_.min_x) >> grid_.shift;
+          size_t j = size_t(int64_t(point.y) - grid_.min_y) >> grid_.shift;
+          return grid_.cells[j * grid_.columns + i];
+        }
+
+        size_t memory_usage() const;
+
+      private:
+        // covered as for find_child_kernel
+        bool find_child(child_block const * first, child_block const * last,
+                        point_type const & point, bool covered,
+                        id_type & result) const;
+
+        // position of child among the children of node
+        size_t rank(id_type node, id_type child) const;
+
+        // sets the cells [i0, i1) x [j0, j1) from node, which contains them
+        void fill_grid(size_t i0, size_t i1, size_t j0, size_t j1, id_type node);
+
+      private:
+        // the arrays of an owning layout
+        struct vectors_type
+        {
+          std::vector<child_block> blocks;
+          std::vector<wide_block> wide_blocks;
+          std::vector<uint32_t> offsets;
+          std::vector<id_type> original_ids;
+          std::vector<id_type> nodes;
+        };
+
+        // The arrays, pointing into vectors when owned. Copies and moves
+        // point them at their own vectors, so the layout needs no
+        // copy or move operations of its own.
+        struct storage_type : arrays
+        {
+          bool owned = false;
+          vectors_type vectors;
+
+          storage_type() {}
+          storage_type(arrays const & data)
+            : arrays(data)
+          {}
+          storage_type(storage_type const & other);
+          storage_type & operator =(storage_type const & other);
+          storage_type(storage_type && other);
+          storage_type & operator =(storage_type && other);
+
+          // points the arrays at vectors
+          void bind();
+        };
+
+        storage_type data_;
+        find_child_kernel kernel_ = nullptr;
+
+        // square cells of side 2^shift from (min_x, min_y), by rows
+        struct grid_type
+        {
+          std::vector<id_type> cells;
+          int64_t min_x = 0, min_y = 0;
+          unsigned shift = 0;
+          size_t columns = 0, rows = 0;
+        };
+
+        grid_type grid_;
+      };
+
+      inline bool query_layout::find_child(child_block const * first,
+                                           child_block const * last,
+                                           point_type const & point,
+                                           bool covered,
+                                           id_type & result) const
+      {
+        wide_block const * wide = data_.wide_blocks
+          ? data_.wide_blocks + (first - data_.blocks) : nullptr;
+        return find_child_any(kernel_, wide, first, last, point, covered, result);
+      }
+
+      template <typename Stats>
+      id_type query_layout::locate(point_type const & point, Stats & stats) const
+      {
+        stats.begin();
+        id_type node = 0;
+        wide_point_type const * root = data_.root;
+        if (triangle_type<wide_point_type>(root[0], root[1], root[2]).contains(point))
+          {
+            // the children of a node cover it, and the point is in the node
+            node = start_node(point);
+            id_type child;
+            while (find_child(data_.blocks + data_.offsets[node],
+                              data_.blocks + data_.offsets[node + 1],
+                              point, true, child))
+              {
+                if (Stats::ENABLED)
+                  {
+                    // the last child is taken untested
+                    size_t tested = rank(node, child) + 1;
+                    stats.test(tested == children_num(node) ? tested - 1 : tested);
+                  }
+                stats.descend();
+                node = child;
+              }
+            if (Stats::ENABLED)
+              stats.test(children_num(node));
+          }
+        stats.end();
+        return data_.original_ids[node];
+      }
+    }
+  }
+}
+
+#endif // _QUERY_LAYOUT_H
@@ -0,0 +1,39 @@
+#include "query_stats.h"
+
+#include <ostream>
+
+namespace geom
+{
+  namespace algorithms
+  {
+    namespace localization
+    {
+      void query_stats::merge(query_stats const & other)
+      {
+        queries += other.queries;
+        levels += other.levels;
+        tests += other.tests;
+        max_levels = std::max(max_levels, other.max_levels);
+        max_tests = std::max(max_tests, other.max_tests);
+        if (levels_histogram.size() < other.levels_histogram.size())
+          levels_histogram.resize(other.levels_histogram.size());
+        for (size_t i = 0; i < other.levels_histogram.size(); ++i)
+          levels_histogram[i] += other.levels_histogram[i];
+      }
+
+      std::ostream & operator <<(std::ostream & out, query_stats const & stats)
+      {
+        out << "queries " << stats.queries
+            << ", levels " << stats.average_levels() << " average, "
+            << stats.max_levels << " max"
+            << ", tests " << stats.average_tests() << " average, "
+            << stats.max_tests << " max\n";
+        out << "queries by levels walked:";
+        for (size_t i = 0; i < stats.levels_histogram.size(); ++i)
+          if (stats.levels_histogram[i] != 0)
+            out << " " << i << ":" << stats.levels_histogram[i];
+        return out << "\n";
+      }
+    }
+  }
+}
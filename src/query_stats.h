@@ -0,0 +1,95 @@
+#ifndef _QUERY_STATS_H
+#define _QUERY_STATS_H
+
+#include <algorithm>
+#include <cstddef>
+#include <iosfwd>
+#include <vector>
+
+namespace geom
+{
+  namespace algorithms
+  {
+    namespace localization
+    {
+      // Statistics policy of the query functions. Every query calls
+      // begin(), then test(n) for the n child triangles tested at each
+      // node it visits and descend() for each edge it follows, then end().
+      // no_stats compiles to the plain query.
+      struct no_stats
+      {
+        static const bool ENABLED = false;
+
+        void begin() {}
+        void test(size_t) {}
+        void descend() {}
+        void end() {}
+      };
+
+      // Counters summed over all queries; merge the stats of threads
+      // that queried separately.
+      struct query_stats
+      {
+        static const bool ENABLED = true;
+
+        size_t queries = 0;
+        // dag edges followed
+        size_t levels = 0;
+        // child triangles tested
+        size_t tests = 0;
+        size_t max_levels = 0;
+        size_t max_tests = 0;
+        // number of queries by the levels they walked
+        std::vector<size_t> levels_histogram;
+
+        void begin()
+        {
+          query_levels_ = 0;
+          query_tests_ = 0;
+        }
+
+        void test(size_t n)
+        {
+          query_tests_ += n;
+        }
+
+        void descend()
+        {
+          ++query_levels_;
+        }
+
+        void end()
+        {
+          ++queries;
+          levels += query_levels_;
+          tests += query_tests_;
+          max_levels = std::max(max_levels, query_levels_);
+          max_tests = std::max(max_tests, query_tests_);
+          if (levels_histogram.size() <= query_levels_)
+            levels_histogram.resize(query_levels_ + 1);
+          ++levels_histogram[query_levels_];
+        }
+
+        void merge(query_stats const & other);
+
+        double average_levels() const
+        {
+          return queries ? double(levels) / queries : 0;
+        }
+
+        double average_tests() const
+        {
+          return queries ? double(tests) / queries : 0;
+        }
+
+      private:
+        size_t query_levels_ = 0;
+        size_t query_tests_ = 0;
+      };
+
+      std::ostream & operator <<(std::ostream & out, query_stats const & stats);
+    }
+  }
+}
+
+#endif // _QUERY_STATS_H
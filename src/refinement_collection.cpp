@@ -0,0 +1,258 @@
+#include "refinement_collection.h"
+
+#include <algorithm>
+#include <cassert>
+#include <limits>
+#include <stdexcept>
+
+namespace geom
+{
+  namespace algorithms
+  {
+    namespace localization
+    {
+      refinement_collection::refinement_collection()
+        : offsets_(1, 0)
+        , kernel_(best_find_child_kernel())
+      {}
+
+      refinement_collection::id_type
+      refinement_collection::add(kirkpatrick_refinement const & refinement)
+      {
+        query_layout const & layout = refinement.layout();
+        query_layout::arrays const & data = layout.data();
+        const uint64_t node_base = original_ids_.size();
+        const uint64_t block_base = blocks_.size();
+        const uint64_t limit = std::numeric_limits<uint32_t>::max();
+        if (node_base + data.nodes_num > limit || block_base + data.blocks_num > limit)
+          throw std::length_error("refinement_collection: too many nodes");
+        assert(data.offsets[0] == 0);
+
+        for (size_t b = 0; b < data.blocks_num; ++b)
+          {
+            child_block block = data.blocks[b];
+            for (uint32_t i = 0; i < block.size; ++i)
+              block.id[i] += node_base;
+            blocks_.push_back(block);
+          }
+        const size_t wide_base = wide_blocks_.size();
+        if (data.wide_blocks)
+          wide_blocks_.insert(wide_blocks_.end(), data.wide_blocks,
+                              data.wide_blocks + data.blocks_num);
+        for (id_type node = 0; node < data.nodes_num; ++node)
+          {
+            offsets_.push_back(block_base + data.offsets[node + 1]);
+            id_type original = data.original_ids[node];
+            original_ids_.push_back(original);
+            faces_.push_back(layout.is_leaf(node) ? refinement.face_of(original)
+                             : kirkpatrick_refinement::NO_FACE);
+          }
+
+        auto const & points = refinement.points();
+        polygon_type polygon;
+        std::copy(data.root, data.root + 3, polygon.root);
+        polygon.min = polygon.max = points[0];
+        for (size_t i = 1; i < points.size(); ++i)
+          {
+            polygon.min = point_type(std::min(polygon.min.x, points[i].x),
+                                     std::min(polygon.min.y, points[i].y));
+            polygon.max = point_type(std::max(polygon.max.x, points[i].x),
+                                     std::max(polygon.max.y, points[i].y));
+          }
+        polygon.root_node = node_base;
+        polygon.block_base = block_base;
+        polygon.wide_base = wide_base;
+        polygon.narrow = !data.wide_blocks;
+        polygons_.push_back(polygon);
+        indexed_ = false;
+        return polygons_.size() - 1;
+      }
+
+      refinement_collection::id_type
+      refinement_collection::add(std::vector<point_type> const & poly,
+                                 construction_options const & options)
+      {
+        return add(kirkpatrick_refinement(poly, options));
+      }
+
+      void refinement_collection::build_index(double cells_per_polygon)
+      {
+        // no more growth until the next add
+        polygons_.shrink_to_fit();
+        blocks_.shrink_to_fit();
+        wide_blocks_.shrink_to_fit();
+        offsets_.shrink_to_fit();
+        original_ids_.shrink_to_fit();
+        faces_.shrink_to_fit();
+
+        indexed_ = true;
+        columns_ = rows_ = 0;
+        cell_offsets_.clear();
+        cell_polygons_.clear();
+        if (polygons_.empty())
+          return;
+
+        int64_t max_x = polygons_[0].max.x, max_y = polygons_[0].max.y;
+        min_x_ = polygons_[0].min.x;
+        min_y_ = polygons_[0].min.y;
+        for (polygon_type const & polygon: polygons_)
+          {
+            min_x_ = std::min<int64_t>(min_x_, polygon.min.x);
+            min_y_ = std::min<int64_t>(min_y_, polygon.min.y);
+            max_x = std::max<int64_t>(max_x, polygon.max.x);
+            max_y = std::max<int64_t>(max_y, polygon.max.y);
+          }
+
+        const size_t budget = size_t(std::max(1.0, cells_per_polygon * polygons_.size()));
+        size_grid(max_x - min_x_, max_y - min_y_, budget, shift_, columns_, rows_);
+
+        // every polygon in the cells its bounding box meets
+        auto cells = [&](polygon_type const & polygon, size_t & i0, size_t & i1,
+                         size_t & j0, size_t & j1)
+          {
+            i0 = (polygon.min.x - min_x_) >> shift_;
+            i1 = ((polygon.max.x - min_x_) >> shift_) + 1;
+            j0 = (polygon.min.y - min_y_) >> shift_;
+            j1 = ((polygon.max.y - min_y_) >> shift_) + 1;
+          };
+        cell_offsets_.assign(columns_ * rows_ + 1, 0);
+        size_t i0, i1, j0, j1;
+        for (polygon_type const & polygon: polygons_)
+          {
+            cells(polygon, i0, i1, j0, j1);
+            for (size_t j = j0; j != j1; ++j)
+              for (size_t i = i0; i != i1; ++i)
+                ++cell_offsets_[j * columns_ + i + 1];
+          }
+        for (size_t k = 1; k < cell_offsets_.size(); ++k)
+          cell_offsets_[k] += cell_offsets_[k - 1];
+        std::vector<size_t> next(cell_offsets_.begin(), cell_offsets_.end() - 1);
+        cell_polygons_.resize(cell_offsets_.back());
+        for (id_type p = 0; p < polygons_.size(); ++p)
+          {
+            cells(polygons_[p], i0, i1, j0, j1);
+            for (size_t j = j0; j != j1; ++j)
+              for (size_t i = i0; i != i1; ++i)
+                cell_polygons_[next[j * columns_ + i]++] = p;
+          }
+      }
+
+      std::vector<refinement_collection::hit_type>
+      refinement_collection::find_containing(point_type const & point) const
+      {
+        std::vector<size_t> offsets;
+        std::vector<hit_type> hits;
+        find_containing(&point, 1, offsets, hits);
+        return hits;
+      }
+
+      void refinement_collection::find_containing(point_type const * points, size_t count,
+                                                  std::vector<size_t> & offsets,
+                                                  std::vector<hit_type> & hits) const
+      {
+        if (!indexed_)
+          throw std::logic_error("refinement_collection: build_index after add");
+
+        // points per round, bounding the candidates in memory
+        const size_t CHUNK = 1024;
+        std::vector<candidate_type> candidates;
+        offsets.resize(count + 1);
+        hits.clear();
+        for (size_t first = 0; first < count; first += CHUNK)
+          {
+            size_t size = std::min(CHUNK, count - first);
+            candidates.clear();
+            for (size_t i = 0; i < size; ++i)
+              collect(points[first + i], first + i, candidates);
+            descend(points, candidates);
+
+            // the candidates left are still in point order
+            size_t c = 0;
+            for (size_t i = first; i < first + size; ++i)
+              {
+                offsets[i] = hits.size();
+                for (; c < candidates.size() && candidates[c].point == i; ++c)
+                  hits.push_back(hit_type{candidates[c].polygon,
+                                          original_ids_[candidates[c].node]});
+              }
+          }
+        offsets[count] = hits.size();
+      }
+
+      size_t refinement_collection::memory_usage() const
+      {
+        return sizeof(*this) + polygons_.capacity() * sizeof(polygon_type)
+          + blocks_.capacity() * sizeof(child_block)
+          + wide_blocks_.capacity() * sizeof(wide_block)
+          + offsets_.capacity() * sizeof(uint32_t)
+          + original_ids_.capacity() * sizeof(id_type)
+          + faces_.capacity() * sizeof(id_type)
+          + cell_offsets_.capacity() * sizeof(size_t)
+          + cell_polygons_.capacity() * sizeof(id_type);
+      }
+
+      void refinement_collection::collect(point_type const & point, size_t index,
+                                          std::vector<candidate_type> & candidates) const
+      {
+        int64_t x = int64_t(point.x) - min_x_, y = int64_t(point.y) - min_y_;
+        if (x < 0 || y < 0)
+          return;
+        size_t i = x >> shift_, j = y >> shift_;
+        if (i >= columns_ || j >= rows_)
+          return;
+        size_t cell = j * columns_ + i;
+        for (size_t k = cell_offsets_[cell]; k != cell_offsets_[cell + 1]; ++k)
+          {
+            id_type p = cell_polygons_[k];
+            polygon_type const & polygon = polygons_[p];
+            // the children cover the root only, so the packed kernels
+            // and the untested last child need the point in it
+            if (point.x >= polygon.min.x && point.x <= polygon.max.x
+                && point.y >= polygon.min.y && point.y <= polygon.max.y
+                && triangle_type<wide_point_type>(polygon.root[0], polygon.root[1],
+                                                  polygon.root[2]).contains(point))
+              candidates.push_back(candidate_type{p, polygon.root_node, index});
+          }
+      }
+
+      void refinement_collection::descend(point_type const * points,
+                                          std::vector<candidate_type> & candidates) const
+      {
+        size_t kept = 0;
+        descend_interleaved(candidates.size(),
+                            [](size_t)
+                            {
+                              return true;
+                            },
+                            [&](size_t i)
+                            {
+                              candidate_type & candidate = candidates[i];
+                              if (!find_child(polygons_[candidate.polygon], candidate.node,
+                                              points[candidate.point], candidate.node))
+                                return false;
+                              __builtin_prefetch(blocks_.data() + offsets_[candidate.node]);
+                              return true;
+                            },
+                            [&](size_t first, size_t last)
+                            {
+                              for (size_t i = first; i < last; ++i)
+                                if (faces_[candidates[i].node]
+                                    != kirkpatrick_refinement::NO_FACE)
+                                  candidates[kept++] = candidates[i];
+                            });
+        candidates.resize(kept);
+      }
+
+      bool refinement_collection::find_child(polygon_type const & polygon, id_type node,
+                                             point_type const & point,
+                                             id_type & result) const
+      {
+        child_block const * first = blocks_.data() + offsets_[node];
+        child_block const * last = blocks_.data() + offsets_[node + 1];
+        wide_block const * wide = polygon.narrow ? nullptr
+          : wide_blocks_.data() + polygon.wide_base + (offsets_[node] - polygon.block_base);
+        return find_child_any(kernel_, wide, first, last, point, true, result);
+      }
+    }
+  }
+}
@@ -0,0 +1,130 @@
+#ifndef _REFINEMENT_COLLECTION_H
+#define _REFINEMENT_COLLECTION_H
+
+#include "kirkpatrick_refinement.h"
+#include "query_layout.h"
+#include "turn_kernels.h"
+
+#include <vector>
+
+namespace geom
+{
+  namespace algorithms
+  {
+    namespace localization
+    {
+      // Many independent polygons answering which of them contain a
+      // point. The query layouts of all of them are packed into shared
+      // arrays, with node numbers and block offsets rebased so a single
+      // offsets array spans every polygon, and a grid over the bounding
+      // boxes of the polygons picks the candidates of a point. Nothing
+      // of the refinements is kept but their layouts and faces.
+      struct refinement_collection
+      {
+        typedef uint32_t id_type;
+
+        // a polygon containing a point and the leaf triangle of the
+        // point in it, as find_query of the polygon's refinement gives
+        struct hit_type
+        {
+          id_type polygon;
+          id_type triangle;
+        };
+
+        refinement_collection();
+
+        // Adds a polygon, returns its number. The collection answers no
+        // queries until build_index. Throws std::length_error when the
+        // nodes or child blocks of all polygons pass 2^32.
+        id_type add(kirkpatrick_refinement const & refinement);
+        id_type add(std::vector<point_type> const & poly,
+                    construction_options const & options = construction_options());
+
+        // Grid over the polygons added so far, about cells_per_polygon
+        // cells per polygon.
+        void build_index(double cells_per_polygon = 2);
+
+        // polygons containing point, by number; points on a boundary
+        // may go either way. Throws std::logic_error after an add
+        // without build_index.
+        std::vector<hit_type> find_containing(point_type const & point) const;
+        // The polygons containing every point are hits[offsets[i],
+        // offsets[i + 1]), by number; offsets gets count + 1 entries.
+        // The descents of several points run interleaved.
+        void find_containing(point_type const * points, size_t count,
+                             std::vector<size_t> & offsets,
+                             std::vector<hit_type> & hits) const;
+
+        size_t polygons_num() const
+        {
+          return polygons_.size();
+        }
+
+        size_t nodes_num() const
+        {
+          return original_ids_.size();
+        }
+
+        size_t memory_usage() const;
+
+      private:
+        struct polygon_type
+        {
+          wide_point_type root[3];
+          // bounding box of the polygon points, inclusive
+          point_type min, max;
+          // global number of the root node
+          id_type root_node;
+          // the first block of the polygon and, unless narrow, where its
+          // wide coordinates start in wide_blocks_
+          uint32_t block_base, wide_base;
+          bool narrow;
+        };
+
+        // a polygon whose bounding box holds a point, and the node of
+        // the point in it
+        struct candidate_type
+        {
+          id_type polygon;
+          id_type node;
+          size_t point;
+        };
+
+        // descends every candidate to its leaf, GROUP at a time, and
+        // leaves the candidates whose leaf is in a face
+        void descend(point_type const * points, std::vector<candidate_type> & candidates) const;
+
+        // candidates of point, appended in polygon order
+        void collect(point_type const & point, size_t index,
+                     std::vector<candidate_type> & candidates) const;
+
+        bool find_child(polygon_type const & polygon, id_type node,
+                        point_type const & point, id_type & result) const;
+
+      private:
+        std::vector<polygon_type> polygons_;
+        std::vector<child_block> blocks_;
+        std::vector<wide_block> wide_blocks_;
+        // global node numbers, nodes_num + 1 entries
+        std::vector<uint32_t> offsets_;
+        std::vector<id_type> original_ids_;
+        // face of every leaf node, NO_FACE for leaves outside the faces
+        // and for inner nodes
+        std::vector<id_type> faces_;
+        find_child_kernel kernel_;
+
+        // square cells of side 2^shift from (min_x, min_y), by rows, the
+        // polygons of cell k in cell_polygons_[cell_offsets_[k],
+        // cell_offsets_[k + 1])
+        int64_t min_x_ = 0, min_y_ = 0;
+        unsigned shift_ = 0;
+        size_t columns_ = 0, rows_ = 0;
+        std::vector<size_t> cell_offsets_;
+        std::vector<id_type> cell_polygons_;
+        bool indexed_ = true;
+      };
+    }
+  }
+}
+
+#endif // _REFINEMENT_COLLECTION_H
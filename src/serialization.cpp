@@ -0,0 +1,408 @@
+#include "serialization.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace geom
+{
+  namespace algorithms
+  {
+    namespace localization
+    {
+      namespace
+      {
+        enum section
+          {
+            POINTS,
+            TRIANGLES,
+            EDGE_OFFSETS,
+            EDGES,
+            BLOCKS,
+            WIDE_BLOCKS,
+            NODE_OFFSETS,
+            ORIGINAL_IDS,
+            NODES,
+            FACES,
+            SECTIONS_NUM
+          };
+
+        const char MAGIC[8] = {'K', 'I', 'R', 'K', 'D', 'A', 'G', 0};
+        const uint64_t ALIGNMENT = 64;
+        const size_t BLOCK_WORDS = sizeof(child_block) / sizeof(uint32_t);
+        const size_t WIDE_BLOCK_WORDS = sizeof(wide_block) / sizeof(uint32_t);
+
+        static_assert(sizeof(child_block) % sizeof(uint32_t) == 0,
+                      "child blocks are written as 32-bit words");
+        static_assert(sizeof(wide_block) % sizeof(uint64_t) == 0,
+                      "wide blocks are written as 64-bit words");
+
+        // in file order, every field little endian
+        struct file_header
+        {
+          char magic[8];
+          uint32_t version;
+          uint32_t flags;
+          int64_t root[6];
+          uint64_t simple_triangles;
+          // section sizes in 32-bit words and offsets in bytes
+          uint64_t words[SECTIONS_NUM];
+          uint64_t offsets[SECTIONS_NUM];
+        };
+
+        static_assert(sizeof(file_header) == 72 + 16 * SECTIONS_NUM,
+                      "file_header must not be padded");
+
+        uint64_t align(uint64_t offset)
+        {
+          return (offset + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+        }
+
+        // buffered little endian output keeping track of the position
+        struct word_writer
+        {
+          explicit word_writer(std::ostream & out)
+            : out_(out)
+          {
+            buffer_.reserve(BUFFER_SIZE);
+          }
+
+          ~word_writer()
+          {
+            flush();
+          }
+
+          void put(uint32_t word)
+          {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+            word = __builtin_bswap32(word);
+#endif
+            buffer_.push_back(word);
+            position_ += sizeof(uint32_t);
+            if (buffer_.size() == BUFFER_SIZE)
+              flush();
+          }
+
+          void put(uint64_t word)
+          {
+            put(uint32_t(word));
+            put(uint32_t(word >> 32));
+          }
+
+          void put(char const * bytes, size_t size)
+          {
+            flush();
+            out_.write(bytes, size);
+            position_ += size;
+          }
+
+          void pad(uint64_t offset)
+          {
+            while (position_ < offset)
+              put(uint32_t(0));
+          }
+
+          void flush()
+          {
+            out_.write(reinterpret_cast<char const *>(buffer_.data()),
+                       buffer_.size() * sizeof(uint32_t));
+            buffer_.clear();
+          }
+
+        private:
+          static const size_t BUFFER_SIZE = 1 << 14;
+
+          std::ostream & out_;
+          std::vector<uint32_t> buffer_;
+          uint64_t position_ = 0;
+        };
+      }
+
+      void save(kirkpatrick_refinement const & refinement, std::ostream & out)
+      {
+        auto const & points = refinement.points();
+        auto const & triangles = refinement.search_dag().vertices;
+        auto const & layout = refinement.layout().data();
+
+        // the layout keeps the children after compact(), so the edges
+        // are taken from there in their original order
+        uint64_t edges_num = 0;
+        for (size_t i = 0; i < layout.blocks_num; ++i)
+          edges_num += layout.blocks[i].size;
+        if (edges_num > std::numeric_limits<uint32_t>::max())
+          throw std::length_error("save: too many dag edges");
+
+        file_header header;
+        std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.version = FORMAT_VERSION;
+        header.flags = 0;
+        for (size_t i = 0; i < 3; ++i)
+          {
+            header.root[2 * i] = layout.root[i].x;
+            header.root[2 * i + 1] = layout.root[i].y;
+          }
+        header.words[POINTS] = 2 * points.size();
+        header.words[TRIANGLES] = 3 * triangles.size();
+        header.words[EDGE_OFFSETS] = triangles.size() + 1;
+        header.words[EDGES] = edges_num;
+        header.words[BLOCKS] = layout.blocks_num * BLOCK_WORDS;
+        header.words[WIDE_BLOCKS] = layout.wide_blocks ? layout.blocks_num * WIDE_BLOCK_WORDS : 0;
+        header.words[NODE_OFFSETS] = layout.nodes_num + 1;
+        header.words[ORIGINAL_IDS] = layout.nodes_num;
+        header.words[NODES] = layout.triangles_num;
+        header.words[FACES] = refinement.faces_table().size();
+        header.simple_triangles = refinement.simple_triangles_num();
+        uint64_t offset = align(sizeof(file_header));
+        for (size_t s = 0; s < SECTIONS_NUM; ++s)
+          {
+            header.offsets[s] = offset;
+            offset = align(offset + header.words[s] * sizeof(uint32_t));
+          }
+
+        word_writer writer(out);
+        writer.put(header.magic, sizeof(header.magic));
+        writer.put(header.version);
+        writer.put(header.flags);
+        for (int64_t coordinate: header.root)
+          writer.put(uint64_t(coordinate));
+        writer.put(header.simple_triangles);
+        for (uint64_t words: header.words)
+          writer.put(words);
+        for (uint64_t section_offset: header.offsets)
+          writer.put(section_offset);
+
+        writer.pad(header.offsets[POINTS]);
+        for (point_type const & p: points)
+          {
+            writer.put(uint32_t(p.x));
+            writer.put(uint32_t(p.y));
+          }
+
+        writer.pad(header.offsets[TRIANGLES]);
+        for (auto const & t: triangles)
+          {
+            writer.put(t.a);
+            writer.put(t.b);
+            writer.put(t.c);
+          }
+
+        auto children = [&](id_type id, std::function<void(id_type)> const & f)
+          {
+            id_type node = layout.nodes[id];
+            for (uint32_t b = layout.offsets[node]; b != layout.offsets[node + 1]; ++b)
+              for (uint32_t i = 0; i < layout.blocks[b].size; ++i)
+                f(layout.original_ids[layout.blocks[b].id[i]]);
+          };
+
+        writer.pad(header.offsets[EDGE_OFFSETS]);
+        uint32_t edge = 0;
+        for (id_type id = 0; id < triangles.size(); ++id)
+          {
+            writer.put(edge);
+            children(id, [&](id_type) { ++edge; });
+          }
+        writer.put(edge);
+
+        writer.pad(header.offsets[EDGES]);
+        for (id_type id = 0; id < triangles.size(); ++id)
+          children(id, [&](id_type child) { writer.put(child); });
+
+        writer.pad(header.offsets[BLOCKS]);
+        for (size_t i = 0; i < layout.blocks_num; ++i)
+          {
+            auto words = reinterpret_cast<uint32_t const *>(layout.blocks + i);
+            for (size_t w = 0; w < BLOCK_WORDS; ++w)
+              writer.put(words[w]);
+          }
+
+        writer.pad(header.offsets[WIDE_BLOCKS]);
+        if (layout.wide_blocks)
+          for (size_t i = 0; i < layout.blocks_num; ++i)
+            {
+              auto words = reinterpret_cast<uint64_t const *>(layout.wide_blocks + i);
+              for (size_t w = 0; w < WIDE_BLOCK_WORDS / 2; ++w)
+                writer.put(words[w]);
+            }
+
+        writer.pad(header.offsets[NODE_OFFSETS]);
+        for (size_t i = 0; i <= layout.nodes_num; ++i)
+          writer.put(layout.offsets[i]);
+
+        writer.pad(header.offsets[ORIGINAL_IDS]);
+        for (size_t i = 0; i < layout.nodes_num; ++i)
+          writer.put(layout.original_ids[i]);
+
+        writer.pad(header.offsets[NODES]);
+        for (size_t i = 0; i < layout.triangles_num; ++i)
+          writer.put(layout.nodes[i]);
+
+        writer.pad(header.offsets[FACES]);
+        for (id_type face: refinement.faces_table())
+          writer.put(face);
+      }
+
+      void save(kirkpatrick_refinement const & refinement, std::string const & path)
+      {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        if (!out)
+          throw std::runtime_error("save: cannot open " + path);
+        save(refinement, out);
+        out.flush();
+        if (!out)
+          throw std::runtime_error("save: cannot write " + path);
+      }
+
+      mapped_refinement::mapped_refinement(std::string const & path)
+      {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        throw std::runtime_error("mapped_refinement: the format is little endian");
+#endif
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+          throw std::runtime_error("mapped_refinement: cannot open " + path
+                                   + ": " + std::strerror(errno));
+        struct stat info;
+        if (::fstat(fd, &info) != 0)
+          {
+            int error = errno;
+            ::close(fd);
+            throw std::runtime_error("mapped_refinement: cannot stat " + path
+                                     + ": " + std::strerror(error));
+          }
+        size_ = info.st_size;
+        if (size_ < sizeof(file_header))
+          {
+            ::close(fd);
+            throw std::runtime_error("mapped_refinement: " + path + " is truncated");
+          }
+        data_ = ::mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+        int error = errno;
+        ::close(fd);
+        if (data_ == MAP_FAILED)
+          throw std::runtime_error("mapped_refinement: cannot map " + path
+                                   + ": " + std::strerror(error));
+
+        char const * bytes = static_cast<char const *>(data_);
+        file_header header;
+        std::memcpy(&header, bytes, sizeof(header));
+
+        auto fail = [&](std::string const & reason)
+          {
+            ::munmap(data_, size_);
+            throw std::runtime_error("mapped_refinement: " + path + ": " + reason);
+          };
+
+        if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0)
+          fail("not a search dag image");
+        if (header.version != FORMAT_VERSION)
+          fail("unsupported version " + std::to_string(header.version));
+        for (size_t s = 0; s < SECTIONS_NUM; ++s)
+          if (header.offsets[s] % ALIGNMENT != 0 || header.offsets[s] > size_
+              || header.words[s] > (size_ - header.offsets[s]) / sizeof(uint32_t))
+            fail("section out of bounds");
+
+        points_num_ = header.words[POINTS] / 2;
+        triangles_num_ = header.words[TRIANGLES] / 3;
+        size_t nodes_num = header.words[ORIGINAL_IDS];
+        if (header.words[POINTS] % 2 != 0 || points_num_ < 3
+            || header.words[TRIANGLES] % 3 != 0
+            || header.words[EDGE_OFFSETS] != triangles_num_ + 1
+            || header.words[BLOCKS] % BLOCK_WORDS != 0
+            || (header.words[WIDE_BLOCKS] != 0
+                && header.words[WIDE_BLOCKS] / WIDE_BLOCK_WORDS
+                   != header.words[BLOCKS] / BLOCK_WORDS)
+            || header.words[NODE_OFFSETS] != nodes_num + 1
+            || header.words[NODES] != triangles_num_ || nodes_num == 0
+            || header.words[FACES] > triangles_num_
+            || header.simple_triangles >= triangles_num_)
+          fail("inconsistent section sizes");
+
+        auto words = [&](section s)
+          {
+            return reinterpret_cast<uint32_t const *>(bytes + header.offsets[s]);
+          };
+        points_ = reinterpret_cast<int32_t const *>(words(POINTS));
+        triangles_ = words(TRIANGLES);
+        edge_offsets_ = words(EDGE_OFFSETS);
+        edges_ = words(EDGES);
+        faces_ = words(FACES);
+        faces_num_ = header.words[FACES];
+        simple_triangles_num_ = header.simple_triangles;
+
+        query_layout::arrays arrays;
+        arrays.blocks = reinterpret_cast<child_block const *>(words(BLOCKS));
+        arrays.blocks_num = header.words[BLOCKS] / BLOCK_WORDS;
+        arrays.offsets = words(NODE_OFFSETS);
+        arrays.original_ids = words(ORIGINAL_IDS);
+        arrays.nodes_num = nodes_num;
+        arrays.nodes = words(NODES);
+        arrays.triangles_num = triangles_num_;
+        for (size_t i = 0; i < 3; ++i)
+          arrays.root[i] = wide_point_type(header.root[2 * i], header.root[2 * i + 1]);
+        if (header.words[WIDE_BLOCKS] != 0)
+          arrays.wide_blocks = reinterpret_cast<wide_block const *>(words(WIDE_BLOCKS));
+        layout_ = query_layout(arrays);
+      }
+
+      mapped_refinement::~mapped_refinement()
+      {
+        ::munmap(data_, size_);
+      }
+
+      mapped_refinement::id_type
+      mapped_refinement::find_query(point_type const & point) const
+      {
+        return layout_.locate(point);
+      }
+
+      mapped_refinement::id_type
+      mapped_refinement::find_step(point_type const & point, id_type from) const
+      {
+        return layout_.original_id(layout_.step(point, layout_.node_of(from)));
+      }
+
+      void mapped_refinement::find_queries(point_type const * points, size_t count,
+                                           id_type * result) const
+      {
+        layout_.locate(points, count, result);
+      }
+
+      std::vector<mapped_refinement::id_type>
+      mapped_refinement::find_queries(std::vector<point_type> const & points) const
+      {
+        std::vector<id_type> result(points.size());
+        find_queries(points.data(), points.size(), result.data());
+        return result;
+      }
+
+      void mapped_refinement::find_faces(point_type const * points, size_t count,
+                                         id_type * result) const
+      {
+        find_queries(points, count, result);
+        for (size_t i = 0; i < count; ++i)
+          result[i] = face_of(result[i]);
+      }
+
+      bool mapped_refinement::is_leaf(id_type id) const
+      {
+        return children_num(id) == 0;
+      }
+
+      triangle_type<wide_point_type>
+      mapped_refinement::triangle_by_id(id_type id) const
+      {
+        id_type const * t = triangles_ + 3 * id;
+        return triangle_type<wide_point_type>(point(t[0]), point(t[1]), point(t[2]));
+      }
+    }
+  }
+}
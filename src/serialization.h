@@ -0,0 +1,147 @@
+#ifndef _SERIALIZATION_H
+#define _SERIALIZATION_H
+
+#include "kirkpatrick_refinement.h"
+#include "query_layout.h"
+
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+namespace geom
+{
+  namespace algorithms
+  {
+    namespace localization
+    {
+      // Binary image of a built kirkpatrick_refinement. All values are
+      // little endian 32-bit words, 64-bit ones low word first, sections
+      // start at 64 byte offsets:
+      //
+      //   header        magic, version, flags, root, simple triangles,
+      //                 section sizes and offsets; the root corners are
+      //                 64-bit and follow the points as vertices
+      //   points        x, y per input point
+      //   triangles     a, b, c per dag vertex
+      //   edge offsets  triangles_num + 1 offsets into edges
+      //   edges         children of every triangle, flattened
+      //   blocks        the query layout child blocks
+      //   wide blocks   their 64-bit coordinates, empty when they fit
+      //                 the packed kernels
+      //   node offsets  nodes_num + 1 offsets into blocks
+      //   original ids  original triangle id of every layout node
+      //   nodes         layout node of every triangle
+      //   faces         face of every leaf of the initial triangulation
+      const uint32_t FORMAT_VERSION = 3;
+
+      void save(kirkpatrick_refinement const & refinement, std::ostream & out);
+      void save(kirkpatrick_refinement const & refinement, std::string const & path);
+
+      // Read-only hierarchy over a file written by save, mapped into
+      // memory and queried in place, so processes opening the same file
+      // share its pages. Throws std::runtime_error on files that are not
+      // in the format; the contents themselves are trusted.
+      struct mapped_refinement
+      {
+        typedef uint32_t id_type;
+
+        explicit mapped_refinement(std::string const & path);
+        ~mapped_refinement();
+
+        mapped_refinement(mapped_refinement const &) = delete;
+        mapped_refinement & operator =(mapped_refinement const &) = delete;
+
+        id_type find_query(point_type const & point) const;
+        id_type find_step(point_type const & point, id_type from = 0) const;
+
+        void find_queries(point_type const * points, size_t count,
+                          id_type * result) const;
+        std::vector<id_type> find_queries(std::vector<point_type> const & points) const;
+
+        bool is_leaf(id_type id) const;
+
+        // as kirkpatrick_refinement::build_grid, the grid is not mapped
+        void build_grid(size_t memory_budget)
+        {
+          layout_.build_grid(memory_budget);
+        }
+
+        id_type face_of(id_type id) const
+        {
+          return id < faces_num_ ? faces_[id] : kirkpatrick_refinement::NO_FACE;
+        }
+
+        id_type find_face(point_type const & point) const
+        {
+          return face_of(find_query(point));
+        }
+
+        void find_faces(point_type const * points, size_t count,
+                        id_type * result) const;
+
+        size_t children_num(id_type id) const
+        {
+          return edge_offsets_[id + 1] - edge_offsets_[id];
+        }
+
+        id_type child(id_type id, size_t i) const
+        {
+          return edges_[edge_offsets_[id] + i];
+        }
+
+        // as kirkpatrick_refinement::vertex
+        wide_point_type point(id_type id) const
+        {
+          if (id >= points_num_)
+            return layout_.data().root[id - points_num_];
+          return wide_point_type(points_[2 * id], points_[2 * id + 1]);
+        }
+
+        triangle_type<wide_point_type> triangle_by_id(id_type id) const;
+
+        size_t points_num() const
+        {
+          return points_num_;
+        }
+
+        size_t triangles_num() const
+        {
+          return triangles_num_;
+        }
+
+        size_t simple_triangles_num() const
+        {
+          return simple_triangles_num_;
+        }
+
+        query_layout const & layout() const
+        {
+          return layout_;
+        }
+
+        size_t mapped_size() const
+        {
+          return size_;
+        }
+
+      private:
+        void * data_ = nullptr;
+        size_t size_ = 0;
+
+        int32_t const * points_ = nullptr;
+        size_t points_num_ = 0;
+        id_type const * triangles_ = nullptr;
+        size_t triangles_num_ = 0;
+        uint32_t const * edge_offsets_ = nullptr;
+        id_type const * edges_ = nullptr;
+        id_type const * faces_ = nullptr;
+        size_t faces_num_ = 0;
+        size_t simple_triangles_num_ = 0;
+
+        query_layout layout_;
+      };
+    }
+  }
+}
+
+#endif // _SERIALIZATION_H
@@ -0,0 +1,238 @@
+#ifndef _SNAPSHOT_PUBLISHER_H
+#define _SNAPSHOT_PUBLISHER_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace geom
+{
+  namespace algorithms
+  {
+    // Current version of an immutable structure, replaced while other
+    // threads read it. Readers pin the current snapshot without locks or
+    // waiting; publish swaps in the next one and frees the old one once
+    // no reader can still hold it. A reader announces the epoch it pins
+    // in, a snapshot retired in a later epoch than every announcement is
+    // unreachable. Each reading thread owns a reader.
+    template <typename T>
+    struct snapshot_publisher
+    {
+      // Snapshot pinned by a reader until the guard dies. The guards of
+      // one reader must not overlap.
+      struct guard
+      {
+        guard(guard && other)
+          : slot_(other.slot_)
+          , snapshot_(other.snapshot_)
+        {
+          other.slot_ = nullptr;
+        }
+
+        ~guard()
+        {
+          if (slot_)
+            slot_->store(IDLE, std::memory_order_release);
+        }
+
+        guard(guard const &) = delete;
+        guard & operator =(guard const &) = delete;
+
+        T const & operator *() const
+        {
+          return *snapshot_;
+        }
+
+        T const * operator ->() const
+        {
+          return snapshot_;
+        }
+
+      private:
+        friend struct snapshot_publisher;
+
+        guard(std::atomic<uint64_t> * slot, T const * snapshot)
+          : slot_(slot)
+          , snapshot_(snapshot)
+        {}
+
+      private:
+        std::atomic<uint64_t> * slot_;
+        T const * snapshot_;
+      };
+
+      struct reader
+      {
+        reader(reader && other)
+          : publisher_(other.publisher_)
+          , slot_(other.slot_)
+        {
+          other.publisher_ = nullptr;
+        }
+
+        ~reader()
+        {
+          if (publisher_)
+            publisher_->release(slot_);
+        }
+
+        reader(reader const &) = delete;
+        reader & operator =(reader const &) = delete;
+
+        guard pin() const
+        {
+          return publisher_->pin(slot_);
+        }
+
+      private:
+        friend struct snapshot_publisher;
+
+        reader(snapshot_publisher * publisher, size_t slot)
+          : publisher_(publisher)
+          , slot_(slot)
+        {}
+
+      private:
+        snapshot_publisher * publisher_;
+        size_t slot_;
+      };
+
+      explicit snapshot_publisher(std::unique_ptr<T> initial, size_t max_readers = 64)
+        : current_(initial.release())
+        , epoch_(0)
+        , slots_(new slot_type[max_readers])
+        , slots_num_(max_readers)
+      {
+        for (size_t i = 0; i < slots_num_; ++i)
+          {
+            slots_[i].epoch.store(IDLE);
+            slots_[i].used.store(false);
+          }
+      }
+
+      // all readers must be gone
+      ~snapshot_publisher()
+      {
+        delete current_.load();
+        for (auto const & retired: retired_)
+          delete retired.second;
+      }
+
+      snapshot_publisher(snapshot_publisher const &) = delete;
+      snapshot_publisher & operator =(snapshot_publisher const &) = delete;
+
+      // throws std::length_error when all max_readers readers are taken
+      reader make_reader()
+      {
+        for (size_t i = 0; i < slots_num_; ++i)
+          {
+            bool used = false;
+            if (slots_[i].used.compare_exchange_strong(used, true))
+              return reader(this, i);
+          }
+        throw std::length_error("snapshot_publisher: too many readers");
+      }
+
+      // Makes next the current snapshot. Readers that pinned the old one
+      // keep it; it is freed by a later publish or reclaim.
+      void publish(std::unique_ptr<T> next)
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        T * old = current_.exchange(next.release());
+        retired_.emplace_back(epoch_.fetch_add(1) + 1, old);
+        reclaim_retired();
+      }
+
+      // Publishes the result of build(), a std::unique_ptr<T>, computed
+      // on a thread of its own; readers go on meanwhile.
+      template <typename Build>
+      std::future<void> publish_async(Build build)
+      {
+        return std::async(std::launch::async,
+                          [this, build]()
+                          {
+                            publish(build());
+                          });
+      }
+
+      // frees the retired snapshots no reader can hold, returns the
+      // number left
+      size_t reclaim()
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        reclaim_retired();
+        return retired_.size();
+      }
+
+      uint64_t epoch() const
+      {
+        return epoch_.load();
+      }
+
+    private:
+      static const uint64_t IDLE = uint64_t(-1);
+
+      // padded to two cache lines, so whatever the alignment of the
+      // array no two readers share a line
+      struct slot_type
+      {
+        std::atomic<uint64_t> epoch;
+        std::atomic<bool> used;
+        char padding[128 - sizeof(std::atomic<uint64_t>) - sizeof(std::atomic<bool>)];
+      };
+
+      // The announcement is ordered before the load of current_, which
+      // is before the exchange of a publish it misses, before the epoch
+      // increment and before reclaim reads the announcement.
+      guard pin(size_t slot)
+      {
+        std::atomic<uint64_t> & epoch = slots_[slot].epoch;
+        epoch.store(epoch_.load());
+        return guard(&epoch, current_.load());
+      }
+
+      void release(size_t slot)
+      {
+        slots_[slot].epoch.store(IDLE);
+        slots_[slot].used.store(false);
+      }
+
+      void reclaim_retired()
+      {
+        uint64_t oldest = IDLE;
+        for (size_t i = 0; i < slots_num_; ++i)
+          oldest = std::min<uint64_t>(oldest, slots_[i].epoch.load());
+        auto kept = std::partition(retired_.begin(), retired_.end(),
+                                   [oldest](std::pair<uint64_t, T *> const & retired)
+                                   {
+                                     return retired.first > oldest;
+                                   });
+        for (auto it = kept; it != retired_.end(); ++it)
+          delete it->second;
+        retired_.erase(kept, retired_.end());
+      }
+
+    private:
+      std::atomic<T *> current_;
+      std::atomic<uint64_t> epoch_;
+      std::unique_ptr<slot_type[]> slots_;
+      const size_t slots_num_;
+
+      // serializes publishers
+      std::mutex mutex_;
+      // snapshots replaced in the epoch they were retired in
+      std::vector<std::pair<uint64_t, T *>> retired_;
+    };
+
+    template <typename T>
+    const uint64_t snapshot_publisher<T>::IDLE;
+  }
+}
+
+#endif // _SNAPSHOT_PUBLISHER_H
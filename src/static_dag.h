@@ -0,0 +1,254 @@
+#ifndef _STATIC_DAG_H
+#define _STATIC_DAG_H
+
+#include "kirkpatrick_refinement.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+namespace geom
+{
+  namespace algorithms
+  {
+    namespace localization
+    {
+      // Frozen copy of a kirkpatrick_refinement for small maps, with the
+      // storage fixed at compile time: corners as Coord offsets from the
+      // lower left corner of the bounding triangle, node numbers and ids
+      // as Index, and every inner node holding its children in an array
+      // of MaxFanout, so the child loop of a query unrolls. Inner nodes
+      // come first, so a node is a leaf when its number is at least
+      // inner_num(). static_dag<uint16_t, uint16_t, 11> takes 14 bytes
+      // per node, 2 more per leaf and 24 more per inner node.
+      template <typename Coord, typename Index, size_t MaxFanout>
+      struct static_dag
+      {
+        static_assert(std::is_unsigned<Coord>::value && sizeof(Coord) <= 4,
+                      "static_dag: Coord is an unsigned type of at most 32 bits");
+        static_assert(std::is_unsigned<Index>::value && sizeof(Index) <= 4,
+                      "static_dag: Index is an unsigned type of at most 32 bits");
+        static_assert(MaxFanout >= 2 && MaxFanout <= 255,
+                      "static_dag: MaxFanout out of [2, 255]");
+
+        typedef kirkpatrick_refinement::id_type id_type;
+
+        // Whether refinement fits: its triangles and faces number below
+        // the Index maximum, no triangle has more than MaxFanout
+        // children, and its bounding triangle spans at most the Coord
+        // maximum and 2^31 - 1, which keeps the turn products exact.
+        static bool fits(kirkpatrick_refinement const & refinement);
+
+        // throws std::length_error unless fits(refinement)
+        explicit static_dag(kirkpatrick_refinement const & refinement);
+
+        // the id the refinement gives, up to the choice on edges
+        id_type find_query(point_type const & point) const
+        {
+          return original_ids_[locate(point)];
+        }
+
+        id_type find_face(point_type const & point) const
+        {
+          Index node = locate(point);
+          if (node < inner_.size())
+            return kirkpatrick_refinement::NO_FACE;
+          Index face = faces_[node - inner_.size()];
+          return face == NO_FACE ? kirkpatrick_refinement::NO_FACE : face;
+        }
+
+        size_t nodes_num() const
+        {
+          return original_ids_.size();
+        }
+
+        size_t inner_num() const
+        {
+          return inner_.size();
+        }
+
+        size_t memory_usage() const
+        {
+          return sizeof(*this) + inner_.capacity() * sizeof(inner_node)
+            + corners_.capacity() * sizeof(corners_type)
+            + original_ids_.capacity() * sizeof(Index)
+            + faces_.capacity() * sizeof(Index);
+        }
+
+      private:
+        static const Index NO_FACE = std::numeric_limits<Index>::max();
+
+        struct inner_node
+        {
+          Index children[MaxFanout];
+          uint8_t size;
+        };
+
+        struct corners_type
+        {
+          Coord x[3], y[3];
+        };
+
+        // bounding box of the root triangle of layout
+        static void root_box(query_layout const & layout,
+                             int64_t & min_x, int64_t & min_y,
+                             int64_t & max_x, int64_t & max_y);
+
+        // node of the deepest triangle containing point, the root when
+        // none does
+        Index locate(point_type const & point) const;
+
+        bool contains(Index node, int64_t x, int64_t y) const
+        {
+          corners_type const & c = corners_[node];
+          for (size_t k = 0; k < 3; ++k)
+            {
+              size_t next = k == 2 ? 0 : k + 1;
+              int64_t ax = c.x[k], ay = c.y[k];
+              if ((int64_t(c.x[next]) - ax) * (y - ay) - (int64_t(c.y[next]) - ay) * (x - ax) < 0)
+                return false;
+            }
+          return true;
+        }
+
+      private:
+        int64_t min_x_, min_y_, max_x_, max_y_;
+        std::vector<inner_node> inner_;
+        std::vector<corners_type> corners_;
+        std::vector<Index> original_ids_;
+        // face of every leaf, from node inner_num()
+        std::vector<Index> faces_;
+      };
+
+      template <typename Coord, typename Index, size_t MaxFanout>
+      void static_dag<Coord, Index, MaxFanout>::root_box(query_layout const & layout,
+                                                         int64_t & min_x, int64_t & min_y,
+                                                         int64_t & max_x, int64_t & max_y)
+      {
+        wide_point_type const * root = layout.data().root;
+        min_x = max_x = root[0].x;
+        min_y = max_y = root[0].y;
+        for (size_t k = 1; k < 3; ++k)
+          {
+            min_x = std::min(min_x, root[k].x);
+            max_x = std::max(max_x, root[k].x);
+            min_y = std::min(min_y, root[k].y);
+            max_y = std::max(max_y, root[k].y);
+          }
+      }
+
+      template <typename Coord, typename Index, size_t MaxFanout>
+      bool static_dag<Coord, Index, MaxFanout>::fits(kirkpatrick_refinement const & refinement)
+      {
+        query_layout const & layout = refinement.layout();
+        const uint64_t index_max = std::numeric_limits<Index>::max();
+        if (layout.nodes_num() >= index_max || refinement.triangles_num() >= index_max)
+          return false;
+        for (id_type face: refinement.faces_table())
+          if (face != kirkpatrick_refinement::NO_FACE && face >= index_max)
+            return false;
+        for (id_type node = 0; node < layout.nodes_num(); ++node)
+          if (layout.children_num(node) > MaxFanout)
+            return false;
+
+        int64_t min_x, min_y, max_x, max_y;
+        root_box(layout, min_x, min_y, max_x, max_y);
+        const int64_t span = std::min<int64_t>(std::numeric_limits<Coord>::max(),
+                                               std::numeric_limits<int32_t>::max());
+        return max_x - min_x <= span && max_y - min_y <= span;
+      }
+
+      template <typename Coord, typename Index, size_t MaxFanout>
+      static_dag<Coord, Index, MaxFanout>::static_dag(kirkpatrick_refinement const & refinement)
+      {
+        if (!fits(refinement))
+          throw std::length_error("static_dag: the refinement does not fit");
+
+        // every triangle lies within the box of the bounding triangle
+        query_layout const & layout = refinement.layout();
+        root_box(layout, min_x_, min_y_, max_x_, max_y_);
+
+        // inner nodes, then leaves, each in layout order
+        const size_t n = layout.nodes_num();
+        std::vector<Index> numbers(n);
+        size_t inner_num = 0;
+        for (id_type node = 0; node < n; ++node)
+          if (!layout.is_leaf(node))
+            numbers[node] = inner_num++;
+        size_t leaf = inner_num;
+        for (id_type node = 0; node < n; ++node)
+          if (layout.is_leaf(node))
+            numbers[node] = leaf++;
+
+        inner_.resize(inner_num);
+        corners_.resize(n);
+        original_ids_.resize(n);
+        faces_.resize(n - inner_num);
+        for (id_type node = 0; node < n; ++node)
+          {
+            Index number = numbers[node];
+            id_type original = layout.original_id(node);
+            original_ids_[number] = original;
+            auto const & t = refinement.search_dag().vertices[original];
+            id_type corners[] = {t.a, t.b, t.c};
+            for (size_t k = 0; k < 3; ++k)
+              {
+                wide_point_type corner = refinement.vertex(corners[k]);
+                corners_[number].x[k] = Coord(corner.x - min_x_);
+                corners_[number].y[k] = Coord(corner.y - min_y_);
+              }
+            if (number < inner_num)
+              {
+                inner_node & inner = inner_[number];
+                inner.size = 0;
+                layout.for_each_child(node, [&](id_type child)
+                                      {
+                                        inner.children[inner.size++] = numbers[child];
+                                      });
+                for (size_t k = inner.size; k < MaxFanout; ++k)
+                  inner.children[k] = inner.children[inner.size - 1];
+              }
+            else
+              {
+                id_type face = refinement.face_of(original);
+                faces_[number - inner_num] = face == kirkpatrick_refinement::NO_FACE
+                  ? NO_FACE : Index(face);
+              }
+          }
+      }
+
+      template <typename Coord, typename Index, size_t MaxFanout>
+      Index static_dag<Coord, Index, MaxFanout>::locate(point_type const & point) const
+      {
+        if (point.x < min_x_ || point.x > max_x_ || point.y < min_y_ || point.y > max_y_)
+          return 0;
+        const int64_t x = point.x - min_x_, y = point.y - min_y_;
+        Index node = 0;
+        if (!contains(node, x, y))
+          return 0;
+        // the children cover their parent, so the last one needs no test
+        while (node < inner_.size())
+          {
+            inner_node const & inner = inner_[node];
+            Index next = inner.children[inner.size - 1];
+            for (size_t k = 0; k + 1 < MaxFanout; ++k)
+              if (k + 1 < inner.size && contains(inner.children[k], x, y))
+                {
+                  next = inner.children[k];
+                  break;
+                }
+            node = next;
+          }
+        return node;
+      }
+
+      template <typename Coord, typename Index, size_t MaxFanout>
+      const Index static_dag<Coord, Index, MaxFanout>::NO_FACE;
+    }
+  }
+}
+
+#endif // _STATIC_DAG_H
@@ -0,0 +1,86 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+
+namespace geom
+{
+  namespace algorithms
+  {
+    thread_pool::thread_pool(size_t threads)
+      : next_(0)
+    {
+      for (size_t i = 1; i < threads; ++i)
+        workers_.emplace_back(&thread_pool::work, this, i);
+    }
+
+    thread_pool::~thread_pool()
+    {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+      }
+      start_.notify_all();
+      for (auto & worker: workers_)
+        worker.join();
+    }
+
+    void thread_pool::parallel_for(size_t count, size_t grain, body_type const & body)
+    {
+      grain = std::max<size_t>(grain, 1);
+      if (workers_.empty() || count <= grain)
+        {
+          if (count != 0)
+            body(0, count, 0);
+          return;
+        }
+
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        body_ = &body;
+        count_ = count;
+        grain_ = grain;
+        next_ = 0;
+        running_ = workers_.size();
+        ++generation_;
+      }
+      start_.notify_all();
+      run_chunks(0);
+
+      std::unique_lock<std::mutex> lock(mutex_);
+      done_.wait(lock, [this] { return running_ == 0; });
+      body_ = nullptr;
+    }
+
+    void thread_pool::work(size_t worker)
+    {
+      size_t seen = 0;
+      while (true)
+        {
+          {
+            std::unique_lock<std::mutex> lock(mutex_);
+            start_.wait(lock, [&] { return stop_ || generation_ != seen; });
+            if (stop_)
+              return;
+            seen = generation_;
+          }
+          run_chunks(worker);
+          {
+            std::lock_guard<std::mutex> lock(mutex_);
+            --running_;
+          }
+          done_.notify_one();
+        }
+    }
+
+    void thread_pool::run_chunks(size_t worker)
+    {
+      while (true)
+        {
+          size_t begin = next_.fetch_add(grain_);
+          if (begin >= count_)
+            return;
+          (*body_)(begin, std::min(begin + grain_, count_), worker);
+        }
+    }
+  }
+}
@@ -0,0 +1,58 @@
+#ifndef _THREAD_POOL_H
+#define _THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace geom
+{
+  namespace algorithms
+  {
+    // Fixed set of workers running one parallel loop at a time. The
+    // calling thread takes part as worker 0.
+    struct thread_pool
+    {
+      // called with [begin, end) and the worker index
+      typedef std::function<void(size_t, size_t, size_t)> body_type;
+
+      explicit thread_pool(size_t threads);
+      ~thread_pool();
+
+      thread_pool(thread_pool const &) = delete;
+      thread_pool & operator =(thread_pool const &) = delete;
+
+      size_t size() const
+      {
+        return workers_.size() + 1;
+      }
+
+      // Splits [0, count) into chunks of at most grain items handed out
+      // dynamically, returns when all of them are done.
+      void parallel_for(size_t count, size_t grain, body_type const & body);
+
+    private:
+      void work(size_t worker);
+      void run_chunks(size_t worker);
+
+    private:
+      std::vector<std::thread> workers_;
+      std::mutex mutex_;
+      std::condition_variable start_;
+      std::condition_variable done_;
+      size_t generation_ = 0;
+      size_t running_ = 0;
+      bool stop_ = false;
+
+      body_type const * body_ = nullptr;
+      size_t count_ = 0;
+      size_t grain_ = 1;
+      std::atomic<size_t> next_;
+    };
+  }
+}
+
+#endif // _THREAD_POOL_H
@@ -1,5 +1,6 @@
 #include "turn.h"
 #include "triangle.h"
+#include "wide_point.h"
 #include "common.h"
 #include "geom/primitives/segment.h"
 
@@ -32,10 +33,10 @@ namespace geom
     template <>
     bool triangle_type<point_type>::intersects(triangle_type<point_type> const & other) const
     {
-      std::vector<segment_type> thiz, that;
-      thiz.emplace_back(a, b); that.emplace_back(other.a, other.b);
-      thiz.emplace_back(b, c); that.emplace_back(other.b, other.c);
-      thiz.emplace_back(c, a); that.emplace_back(other.c, other.a);
+      const segment_type thiz[] = {segment_type(a, b), segment_type(b, c), segment_type(c, a)};
+      const segment_type that[] = {segment_type(other.a, other.b),
+                                   segment_type(other.b, other.c),
+                                   segment_type(other.c, other.a)};
 
       for (auto const & l: thiz)
         for (auto const & r: that)
@@ -48,5 +49,47 @@ namespace geom
 
       return a_in == b_in && b_in == c_in;
     }
+
+    template <>
+    bool triangle_type<wide_point_type>::contains(point_type const & p) const
+    {
+      return turn(a, b, p) >= 0
+          && turn(b, c, p) >= 0
+          && turn(c, a, p) >= 0;
+    }
+
+    // whether segments pq and rs cross in a point inside both
+    bool intersects(wide_point_type const & p, wide_point_type const & q,
+                    wide_point_type const & r, wide_point_type const & s)
+    {
+      return turn(p, q, r) * turn(p, q, s) == -1
+        && turn(r, s, p) * turn(r, s, q) == -1;
+    }
+
+    template <>
+    bool triangle_type<wide_point_type>::intersects(triangle_type<wide_point_type> const & other) const
+    {
+      const wide_point_type thiz[] = {a, b, c};
+      const wide_point_type that[] = {other.a, other.b, other.c};
+
+      for (size_t i = 0; i < 3; ++i)
+        for (size_t j = 0; j < 3; ++j)
+          if (geom::structures::intersects(thiz[i], thiz[(i + 1) % 3],
+                                           that[j], that[(j + 1) % 3]))
+            return true;
+
+      // contains takes input points only
+      auto inside = [&other](wide_point_type const & p)
+      {
+        return turn(other.a, other.b, p) >= 0
+          && turn(other.b, other.c, p) >= 0
+          && turn(other.c, other.a, p) >= 0;
+      };
+      bool a_in = inside(a);
+      bool b_in = inside(b);
+      bool c_in = inside(c);
+
+      return a_in == b_in && b_in == c_in;
+    }
   }
 }
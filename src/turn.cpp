@@ -1,13 +1,13 @@
 #include "turn.h"
-#include "determinant.h"
+#include "predicates.h"
 
-int64_t turn(point_type const & p,
-             point_type const & q,
-             point_type const & r)
+int turn(point_type const & p,
+         point_type const & q,
+         point_type const & r)
 {
-  return det3(p.x, p.y, 1,
-              q.x, q.y, 1,
-              r.x, r.y, 1);
+  return geom::predicates::orientation<int32_t>(p.x, p.y,
+                                                q.x, q.y,
+                                                r.x, r.y);
 }
 
 bool is_left_turn(point_type const & p,
@@ -16,3 +16,19 @@ bool is_left_turn(point_type const & p,
 {
   return turn(p, q, r) > 0;
 }
+
+int turn(wide_point_type const & p,
+         wide_point_type const & q,
+         wide_point_type const & r)
+{
+  return geom::predicates::orientation<int64_t>(p.x, p.y,
+                                                q.x, q.y,
+                                                r.x, r.y);
+}
+
+bool is_left_turn(wide_point_type const & p,
+                  wide_point_type const & q,
+                  wide_point_type const & r)
+{
+  return turn(p, q, r) > 0;
+}
@@ -2,15 +2,27 @@
 #define _TURN_H
 
 #include "geom/primitives/point.h"
+#include "wide_point.h"
 
 using geom::structures::point_type;
+using geom::structures::wide_point_type;
 
-int64_t turn(point_type const & p,
-             point_type const & q,
-             point_type const & r);
+// sign of the orientation of p, q, r, exact for all int32 coordinates
+int turn(point_type const & p,
+         point_type const & q,
+         point_type const & r);
 
 bool is_left_turn(point_type const & p,
                   point_type const & q,
                   point_type const & r);
 
+// the same with the corners of the bounding triangle among the points
+int turn(wide_point_type const & p,
+         wide_point_type const & q,
+         wide_point_type const & r);
+
+bool is_left_turn(wide_point_type const & p,
+                  wide_point_type const & q,
+                  wide_point_type const & r);
+
 #endif // _TURN_H
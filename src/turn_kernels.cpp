@@ -0,0 +1,175 @@
+#include "turn_kernels.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define KIRKPATRICK_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+namespace geom
+{
+  namespace algorithms
+  {
+    namespace localization
+    {
+      namespace
+      {
+        inline int64_t turn(int32_t ox, int32_t oy,
+                            int32_t ex, int32_t ey,
+                            int32_t x, int32_t y)
+        {
+          return int64_t(ex) * (int64_t(y) - oy)
+            - int64_t(ey) * (int64_t(x) - ox);
+        }
+      }
+
+      bool find_child_scalar(child_block const * first,
+                             child_block const * last,
+                             int32_t x, int32_t y,
+                             bool covered,
+                             id_type & result)
+      {
+        for (; first != last; ++first)
+          for (uint32_t i = 0; i < first->size; ++i)
+            if ((covered && first + 1 == last && i + 1 == first->size)
+                || (turn(first->ax[i], first->ay[i], first->abx[i], first->aby[i], x, y) >= 0
+                    && turn(first->bx[i], first->by[i], first->bcx[i], first->bcy[i], x, y) >= 0
+                    && turn(first->cx[i], first->cy[i], first->cax[i], first->cay[i], x, y) >= 0))
+              {
+                result = first->id[i];
+                return true;
+              }
+        return false;
+      }
+
+#ifdef KIRKPATRICK_X86_KERNELS
+      namespace
+      {
+        __attribute__((target("sse4.2")))
+        inline __m128i load2(int32_t const * p)
+        {
+          return _mm_cvtepi32_epi64(_mm_loadl_epi64(reinterpret_cast<__m128i const *>(p)));
+        }
+
+        // non-negative turns of two lanes as an all-ones mask
+        __attribute__((target("sse4.2")))
+        inline __m128i turn_sse(int32_t const * ox, int32_t const * oy,
+                                int32_t const * ex, int32_t const * ey,
+                                __m128i x, __m128i y)
+        {
+          __m128i dx = _mm_sub_epi64(x, load2(ox));
+          __m128i dy = _mm_sub_epi64(y, load2(oy));
+          __m128i t = _mm_sub_epi64(_mm_mul_epi32(load2(ex), dy),
+                                    _mm_mul_epi32(load2(ey), dx));
+          return _mm_cmpgt_epi64(t, _mm_set1_epi64x(-1));
+        }
+
+        __attribute__((target("sse4.2")))
+        bool find_child_sse(child_block const * first,
+                            child_block const * last,
+                            int32_t x, int32_t y,
+                            bool covered,
+                            id_type & result)
+        {
+          __m128i vx = _mm_set1_epi64x(x);
+          __m128i vy = _mm_set1_epi64x(y);
+          for (; first != last; ++first)
+            for (uint32_t i = 0; i < first->size; i += 2)
+              {
+                bool final = covered && first + 1 == last && i + 2 >= first->size;
+                if (final && i + 1 == first->size)
+                  {
+                    result = first->id[i];
+                    return true;
+                  }
+                __m128i in = _mm_and_si128(
+                  _mm_and_si128(turn_sse(first->ax + i, first->ay + i,
+                                         first->abx + i, first->aby + i, vx, vy),
+                                turn_sse(first->bx + i, first->by + i,
+                                         first->bcx + i, first->bcy + i, vx, vy)),
+                  turn_sse(first->cx + i, first->cy + i,
+                           first->cax + i, first->cay + i, vx, vy));
+                int mask = _mm_movemask_pd(_mm_castsi128_pd(in));
+                mask &= (1 << (first->size - i)) - 1;
+                if (final)
+                  mask |= 1 << (first->size - 1 - i);
+                if (mask)
+                  {
+                    result = first->id[i + __builtin_ctz(mask)];
+                    return true;
+                  }
+              }
+          return false;
+        }
+
+        __attribute__((target("avx2")))
+        inline __m256i load4(int32_t const * p)
+        {
+          return _mm256_cvtepi32_epi64(_mm_loadu_si128(reinterpret_cast<__m128i const *>(p)));
+        }
+
+        // non-negative turns of four lanes as an all-ones mask
+        __attribute__((target("avx2")))
+        inline __m256i turn_avx2(int32_t const * ox, int32_t const * oy,
+                                 int32_t const * ex, int32_t const * ey,
+                                 __m256i x, __m256i y)
+        {
+          __m256i dx = _mm256_sub_epi64(x, load4(ox));
+          __m256i dy = _mm256_sub_epi64(y, load4(oy));
+          __m256i t = _mm256_sub_epi64(_mm256_mul_epi32(load4(ex), dy),
+                                       _mm256_mul_epi32(load4(ey), dx));
+          return _mm256_cmpgt_epi64(t, _mm256_set1_epi64x(-1));
+        }
+
+        __attribute__((target("avx2")))
+        bool find_child_avx2(child_block const * first,
+                             child_block const * last,
+                             int32_t x, int32_t y,
+                             bool covered,
+                             id_type & result)
+        {
+          __m256i vx = _mm256_set1_epi64x(x);
+          __m256i vy = _mm256_set1_epi64x(y);
+          for (; first != last; ++first)
+            {
+              bool final = covered && first + 1 == last;
+              if (final && first->size == 1)
+                {
+                  result = first->id[0];
+                  return true;
+                }
+              __m256i in = _mm256_and_si256(
+                _mm256_and_si256(turn_avx2(first->ax, first->ay,
+                                           first->abx, first->aby, vx, vy),
+                                 turn_avx2(first->bx, first->by,
+                                           first->bcx, first->bcy, vx, vy)),
+                turn_avx2(first->cx, first->cy,
+                          first->cax, first->cay, vx, vy));
+              int mask = _mm256_movemask_pd(_mm256_castsi256_pd(in));
+              mask &= (1 << first->size) - 1;
+              if (final)
+                mask |= 1 << (first->size - 1);
+              if (mask)
+                {
+                  result = first->id[__builtin_ctz(mask)];
+                  return true;
+                }
+            }
+          return false;
+        }
+      }
+#endif
+
+      find_child_kernel best_find_child_kernel()
+      {
+#ifdef KIRKPATRICK_X86_KERNELS
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+          return &find_child_avx2;
+        if (__builtin_cpu_supports("sse4.2"))
+          return &find_child_sse;
+#endif
+        return &find_child_scalar;
+      }
+    }
+  }
+}
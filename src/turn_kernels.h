@@ -0,0 +1,136 @@
+#ifndef _TURN_KERNELS_H
+#define _TURN_KERNELS_H
+
+#include "common.h"
+#include "triangle.h"
+#include "wide_point.h"
+
+#include <algorithm>
+
+namespace geom
+{
+  namespace algorithms
+  {
+    namespace localization
+    {
+      // Up to four child triangles of a search dag node in
+      // structure-of-arrays form. Each vertex is stored together with the
+      // vector to the next vertex, so a turn test is two products.
+      struct child_block
+      {
+        static const uint32_t WIDTH = 4;
+
+        int32_t ax[WIDTH], ay[WIDTH], abx[WIDTH], aby[WIDTH];
+        int32_t bx[WIDTH], by[WIDTH], bcx[WIDTH], bcy[WIDTH];
+        int32_t cx[WIDTH], cy[WIDTH], cax[WIDTH], cay[WIDTH];
+        id_type id[WIDTH];
+        uint32_t size;
+      };
+
+      // Exact vertices of the children of the child_block at the same
+      // position, for layouts whose coordinates do not fit the kernels.
+      struct wide_block
+      {
+        int64_t ax[child_block::WIDTH], ay[child_block::WIDTH];
+        int64_t bx[child_block::WIDTH], by[child_block::WIDTH];
+        int64_t cx[child_block::WIDTH], cy[child_block::WIDTH];
+      };
+
+      // Finds the first child in [first, last) containing (x, y).
+      // All coordinate differences must fit in int32_t, so the products
+      // are exact in int64_t. When covered, (x, y) lies in the union of
+      // the children, so the last child is taken without a test.
+      typedef bool (*find_child_kernel)(child_block const * first,
+                                        child_block const * last,
+                                        int32_t x, int32_t y,
+                                        bool covered,
+                                        id_type & result);
+
+      bool find_child_scalar(child_block const * first,
+                             child_block const * last,
+                             int32_t x, int32_t y,
+                             bool covered,
+                             id_type & result);
+
+      // widest kernel supported by the running cpu
+      find_child_kernel best_find_child_kernel();
+
+      // As kernel, or with exact tests on the blocks from wide on, the
+      // wide coordinates of first, when there are such.
+      inline bool find_child_any(find_child_kernel kernel, wide_block const * wide,
+                                 child_block const * first,
+                                 child_block const * last,
+                                 geom::structures::point_type const & point,
+                                 bool covered,
+                                 id_type & result)
+      {
+        using geom::structures::wide_point_type;
+        if (!wide)
+          return kernel(first, last, point.x, point.y, covered, result);
+
+        for (; first != last; ++first, ++wide)
+          for (uint32_t i = 0; i < first->size; ++i)
+            if ((covered && first + 1 == last && i + 1 == first->size)
+                || geom::structures::triangle_type<wide_point_type>(
+                     wide_point_type(wide->ax[i], wide->ay[i]),
+                     wide_point_type(wide->bx[i], wide->by[i]),
+                     wide_point_type(wide->cx[i], wide->cy[i])).contains(point))
+              {
+                result = first->id[i];
+                return true;
+              }
+        return false;
+      }
+
+      // The finest square cells of side 2^shift over a box of width by
+      // height, from its lower left corner, of which there are at most
+      // budget but always one.
+      inline void size_grid(int64_t width, int64_t height, size_t budget,
+                            unsigned & shift, size_t & columns, size_t & rows)
+      {
+        for (shift = 0; ; ++shift)
+          {
+            columns = size_t(width >> shift) + 1;
+            rows = size_t(height >> shift) + 1;
+            if (columns <= budget / rows)
+              break;
+          }
+      }
+
+      // descents in flight, enough to overlap the cache misses of a step
+      const size_t DESCENT_GROUP = 16;
+
+      // Runs the descents [0, count) in groups of DESCENT_GROUP, one step
+      // of every unfinished descent of the group in turn, so that their
+      // cache misses overlap. start(i) sets descent i up and tells
+      // whether it has steps to take, step(i) takes one and tells whether
+      // there are more; done(first, last) follows the group [first,
+      // last).
+      template <typename Start, typename Step, typename Done>
+      void descend_interleaved(size_t count, Start start, Step step, Done done)
+      {
+        size_t active[DESCENT_GROUP];
+        for (size_t first = 0; first < count; first += DESCENT_GROUP)
+          {
+            const size_t last = std::min(count, first + DESCENT_GROUP);
+            size_t active_num = 0;
+            for (size_t i = first; i < last; ++i)
+              if (start(i))
+                active[active_num++] = i;
+
+            while (active_num != 0)
+              {
+                size_t still_active = 0;
+                for (size_t k = 0; k < active_num; ++k)
+                  if (step(active[k]))
+                    active[still_active++] = active[k];
+                active_num = still_active;
+              }
+            done(first, last);
+          }
+      }
+    }
+  }
+}
+
+#endif // _TURN_KERNELS_H
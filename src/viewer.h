@@ -7,12 +7,15 @@
 #include "io/point.h"
 
 #include "kirkpatrick_refinement.h"
+#include "point_io.h"
+#include <algorithm>
 #include <iostream>
 
 using namespace visualization;
 using geom::structures::point_type;
 using geom::structures::contour_type;
 using geom::structures::triangle_type;
+using geom::structures::wide_point_type;
 using geom::algorithms::localization::kirkpatrick_refinement;
 
 namespace geom {
@@ -43,12 +46,22 @@ using geom::structures::contour_builder_type;
 
 namespace visualization {
 
-    void draw(drawer_type & drawer, triangle_type<point_type> const & t)
+    // corners of the bounding triangle may lie outside int32
+    point_type clamp(wide_point_type const & p)
+    {
+        auto coordinate = [](int64_t v)
+        {
+            return int32_t(std::max<int64_t>(INT32_MIN, std::min<int64_t>(INT32_MAX, v)));
+        };
+        return point_type(coordinate(p.x), coordinate(p.y));
+    }
+
+    void draw(drawer_type & drawer, triangle_type<wide_point_type> const & t)
     {
         contour_builder_type builder;
-        builder.add_point(t.a);
-        builder.add_point(t.b);
-        builder.add_point(t.c);
+        builder.add_point(clamp(t.a));
+        builder.add_point(clamp(t.b));
+        builder.add_point(clamp(t.c));
         visualization::draw(drawer, builder.get_result());
     }
 
@@ -110,8 +123,9 @@ void kirkpatrick_refinement_viewer::print(printer_type & printer) const
         for (size_t i = 1; i < pts_.size() - 1; ++i)
         {
             auto t = kre_->triangle_by_id(i);
-            point_type p((t.a.x + t.b.x + t.c.x) / 3 - 2,
-                         (t.a.y + t.b.y + t.c.y) / 3);
+            point_type p = visualization::clamp(
+                wide_point_type((t.a.x + t.b.x + t.c.x) / 3 - 2,
+                                (t.a.y + t.b.y + t.c.y) / 3));
             printer.global_stream(p) << i;
         }
     }
@@ -178,9 +192,14 @@ bool kirkpatrick_refinement_viewer::on_key(int key)
                                                                 ).toStdString();
             if (filename != "")
             {
-                std::ifstream in(filename.c_str());
-                std::istream_iterator<point_type> beg(in), end;
-                pts_.assign(beg, end);
+                try
+                {
+                    pts_ = geom::algorithms::localization::load_points(filename);
+                }
+                catch (std::runtime_error const &)
+                {
+                    return false;
+                }
                 kre_.reset();
                 answer_ = 0;
                 return true;
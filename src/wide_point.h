@@ -0,0 +1,49 @@
+#ifndef _WIDE_POINT_H
+#define _WIDE_POINT_H
+
+#include "geom/primitives/point.h"
+
+#include <cstdint>
+
+namespace geom
+{
+  namespace structures
+  {
+    // Point with 64-bit coordinates. The corners of the bounding
+    // triangle around points spanning the whole int32 range lie outside
+    // it, every other vertex is an input point_type.
+    struct wide_point_type
+    {
+      wide_point_type()
+        : x(0), y(0)
+      {}
+
+      wide_point_type(int64_t x, int64_t y)
+        : x(x), y(y)
+      {}
+
+      wide_point_type(point_type const & point)
+        : x(point.x), y(point.y)
+      {}
+
+      int64_t x, y;
+    };
+
+    inline bool operator ==(wide_point_type const & l, wide_point_type const & r)
+    {
+      return l.x == r.x && l.y == r.y;
+    }
+
+    inline bool operator !=(wide_point_type const & l, wide_point_type const & r)
+    {
+      return !(l == r);
+    }
+
+    inline bool operator <(wide_point_type const & l, wide_point_type const & r)
+    {
+      return l.x < r.x || (l.x == r.x && l.y < r.y);
+    }
+  }
+}
+
+#endif // _WIDE_POINT_H